@@ -5,6 +5,13 @@
 #include <stdexcept>
 #include <memory>
 #include <functional> // Required for std::function used in performOperation
+#include <array>
+#include <climits>
+#include <cmath>
+#include <unordered_map>
+#include <charconv>   // std::to_chars / from_chars for the compressed text format
+#include <cstring>
+#include <unistd.h>   // ::write for streaming to a file descriptor
 
 using namespace std;
 
@@ -14,6 +21,11 @@ public:
     BoundsMismatchException(const string& message) : runtime_error(message) {}
 };
 
+class CompressedFormatException : public runtime_error {
+public:
+    CompressedFormatException(const string& message) : runtime_error(message) {}
+};
+
 // --- Compressed Linked List Structure ---
 // Represents a single run of BLACK (0) pixels: [start, end]
 struct Node {
@@ -35,6 +47,320 @@ public:
     virtual string toStringCompressed() = 0;
 };
 
+// Streaming reader for 8-bit PGM files (P2 ASCII or P5 binary)
+struct PGMReader {
+    istream& in;
+    bool binary = false;
+    int width = 0;
+    int height = 0;
+    int max_value = 255;
+
+    explicit PGMReader(istream& stream) : in(stream) {
+        string magic;
+        in >> magic;
+        if (magic == "P5") binary = true;
+        else if (magic != "P2") throw runtime_error("Unsupported PGM format: " + magic);
+        width = readHeaderInt();
+        height = readHeaderInt();
+        max_value = readHeaderInt();
+        if (width < 0 || height < 0 || max_value <= 0 || max_value > 255) {
+            throw runtime_error("Only 8-bit PGM images are supported.");
+        }
+        if (binary) in.get(); // Single whitespace byte before the raster
+    }
+
+    int readHeaderInt() {
+        in >> ws;
+        while (in.peek() == '#') {
+            string comment;
+            getline(in, comment);
+            in >> ws;
+        }
+        int value = -1;
+        if (!(in >> value)) throw runtime_error("Malformed PGM header.");
+        return value;
+    }
+
+    void readRow(unsigned char* row) {
+        if (binary) {
+            in.read(reinterpret_cast<char*>(row), width);
+            if (in.gcount() != width) throw runtime_error("Unexpected end of PGM data.");
+            for (int j = 0; j < width; ++j) {
+                if (row[j] > max_value) throw runtime_error("PGM sample out of range.");
+            }
+            return;
+        }
+        for (int j = 0; j < width; ++j) {
+            int value;
+            if (!(in >> value)) throw runtime_error("Unexpected end of PGM data.");
+            if (value < 0 || value > max_value) throw runtime_error("PGM sample out of range.");
+            row[j] = static_cast<unsigned char>(value);
+        }
+    }
+};
+
+// --- Run List Helpers ---
+// Rows as plain vectors of inclusive [start, end] black runs, sorted and
+// non-touching. Used by operations that combine several rows at once.
+using RunList = vector<pair<int, int>>;
+
+// Appends [start, end] (start >= back().first), coalescing overlap or contact
+inline void appendMerged(RunList& out, int start, int end) {
+    if (!out.empty() && start <= out.back().second + 1) {
+        out.back().second = max(out.back().second, end);
+    } else {
+        out.emplace_back(start, end);
+    }
+}
+
+inline RunList unionRuns(const RunList& a, const RunList& b) {
+    RunList out;
+    out.reserve(a.size() + b.size());
+    size_t p = 0, q = 0;
+    while (p < a.size() || q < b.size()) {
+        if (q == b.size() || (p < a.size() && a[p].first <= b[q].first)) {
+            appendMerged(out, a[p].first, a[p].second);
+            ++p;
+        } else {
+            appendMerged(out, b[q].first, b[q].second);
+            ++q;
+        }
+    }
+    return out;
+}
+
+inline RunList intersectRuns(const RunList& a, const RunList& b) {
+    RunList out;
+    size_t p = 0, q = 0;
+    while (p < a.size() && q < b.size()) {
+        int start = max(a[p].first, b[q].first);
+        int end = min(a[p].second, b[q].second);
+        if (start <= end) out.emplace_back(start, end);
+        if (a[p].second < b[q].second) ++p;
+        else ++q;
+    }
+    return out;
+}
+
+// Symmetric difference: parity sweep over both lists' run boundaries
+inline RunList xorRuns(const RunList& a, const RunList& b) {
+    RunList out;
+    size_t p = 0, q = 0;
+    bool a_inside = false, b_inside = false;
+    int start = 0;
+    while (p < a.size() || q < b.size()) {
+        // Next boundary of each list: a run start, or one past a run end
+        long long next_a = p < a.size() ? (a_inside ? a[p].second + 1LL : a[p].first) : LLONG_MAX;
+        long long next_b = q < b.size() ? (b_inside ? b[q].second + 1LL : b[q].first) : LLONG_MAX;
+        int position = static_cast<int>(min(next_a, next_b));
+        bool was_black = a_inside != b_inside;
+        if (next_a == position) {
+            if (a_inside) ++p;
+            a_inside = !a_inside;
+        }
+        if (next_b == position) {
+            if (b_inside) ++q;
+            b_inside = !b_inside;
+        }
+        bool is_black = a_inside != b_inside;
+        if (!was_black && is_black) start = position;
+        if (was_black && !is_black) appendMerged(out, start, position - 1);
+    }
+    return out;
+}
+
+// Runs of the white gaps in [0, width)
+inline RunList complementRuns(const RunList& row, int width) {
+    RunList out;
+    int next = 0;
+    for (const pair<int, int>& run : row) {
+        if (run.first > next) out.emplace_back(next, run.first - 1);
+        next = run.second + 1;
+    }
+    if (next < width) out.emplace_back(next, width - 1);
+    return out;
+}
+
+// Union of the row translated by every offset in [offset_lo, offset_hi], clipped to [0, width)
+inline RunList dilateRuns(const RunList& row, int offset_lo, int offset_hi, int width) {
+    RunList out;
+    for (const pair<int, int>& run : row) {
+        int start = max(0, run.first + offset_lo);
+        int end = min(width - 1, run.second + offset_hi);
+        if (start <= end) appendMerged(out, start, end);
+    }
+    return out;
+}
+
+// Pixels p whose window [p + offset_lo, p + offset_hi] is all black, treating
+// everything outside [0, width) as black so borders do not erode.
+inline RunList erodeRuns(const RunList& row, int offset_lo, int offset_hi, int width) {
+    const long long far = 1LL << 40;
+    vector<pair<long long, long long>> extended;
+    extended.emplace_back(-far, -1);
+    for (const pair<int, int>& run : row) {
+        if (run.first <= extended.back().second + 1) extended.back().second = run.second;
+        else extended.emplace_back(run.first, run.second);
+    }
+    if (width <= extended.back().second + 1) extended.back().second = far;
+    else extended.emplace_back(width, far);
+
+    RunList out;
+    for (const pair<long long, long long>& run : extended) {
+        long long start = max(0LL, run.first - offset_lo);
+        long long end = min(static_cast<long long>(width) - 1, run.second - offset_hi);
+        if (start <= end) appendMerged(out, static_cast<int>(start), static_cast<int>(end));
+    }
+    return out;
+}
+
+// --- Rectangle Coverage Index ---
+// Segment tree over rows. Each node stores, for its rows combined, the function
+// F(x) = black pixels in columns [0, x) as a sorted list of breakpoints (run
+// starts and ends + 1) with the value and slope at each, so F is one binary
+// search away. A rectangle query visits O(log height) nodes. Nodes are built
+// by build() and a changed row only invalidates the nodes above it.
+class CoverageIndex {
+private:
+    struct Segment {
+        bool valid = false;
+        vector<int> position;
+        vector<long long> value; // F at position[k]
+        vector<int> slope;       // Black rows covering columns [position[k], position[k + 1])
+    };
+
+    vector<Segment> nodes; // Node 1 covers all rows; children of n are 2n and 2n + 1
+    int rows = 0;
+
+    static long long evaluate(const Segment& segment, int x) {
+        auto it = upper_bound(segment.position.begin(), segment.position.end(), x);
+        if (it == segment.position.begin()) return 0;
+        size_t k = (it - segment.position.begin()) - 1;
+        return segment.value[k] + static_cast<long long>(segment.slope[k]) * (x - segment.position[k]);
+    }
+
+    static void buildLeaf(Segment& segment, const Node* row) {
+        segment.position.clear();
+        segment.value.clear();
+        segment.slope.clear();
+        long long total = 0;
+        for (const Node* current = row; current != nullptr; current = current->next) {
+            segment.position.push_back(current->start_index);
+            segment.value.push_back(total);
+            segment.slope.push_back(1);
+            total += current->end_index - current->start_index + 1;
+            segment.position.push_back(current->end_index + 1);
+            segment.value.push_back(total);
+            segment.slope.push_back(0);
+        }
+    }
+
+    // Sum of two piecewise-linear functions, merged over the union of breakpoints
+    static void merge(Segment& out, const Segment& a, const Segment& b) {
+        out.position.clear();
+        out.value.clear();
+        out.slope.clear();
+        size_t p = 0, q = 0;
+        while (p < a.position.size() || q < b.position.size()) {
+            int x;
+            if (q == b.position.size()) x = a.position[p];
+            else if (p == a.position.size()) x = b.position[q];
+            else x = min(a.position[p], b.position[q]);
+            while (p < a.position.size() && a.position[p] == x) ++p;
+            while (q < b.position.size() && b.position[q] == x) ++q;
+            int slope = (p > 0 ? a.slope[p - 1] : 0) + (q > 0 ? b.slope[q - 1] : 0);
+            out.position.push_back(x);
+            out.value.push_back(evaluate(a, x) + evaluate(b, x));
+            out.slope.push_back(slope);
+        }
+    }
+
+    const Segment& ensure(int node, int lo, int hi, const vector<Node*>& image) {
+        Segment& segment = nodes[node];
+        if (segment.valid) return segment;
+        if (lo == hi) {
+            buildLeaf(segment, image[lo]);
+        } else {
+            int mid = (lo + hi) / 2;
+            const Segment& left = ensure(2 * node, lo, mid, image);
+            const Segment& right = ensure(2 * node + 1, mid + 1, hi, image);
+            merge(segment, left, right);
+        }
+        segment.valid = true;
+        return segment;
+    }
+
+    // Black pixels of one row list inside [x0, x1]
+    static long long countRow(const Node* row, int x0, int x1) {
+        long long total = 0;
+        for (const Node* current = row; current != nullptr && current->start_index <= x1; current = current->next) {
+            int start = max(current->start_index, x0);
+            int end = min(current->end_index, x1);
+            if (start <= end) total += end - start + 1;
+        }
+        return total;
+    }
+
+    // Read-only: covered valid nodes answer directly, stale ones are split into
+    // their children, and a stale leaf is counted from its row list
+    long long query(int node, int lo, int hi, int y0, int y1, int x0, int x1, const vector<Node*>& image) const {
+        if (y1 < lo || hi < y0) return 0;
+        if (y0 <= lo && hi <= y1 && nodes[node].valid) {
+            return evaluate(nodes[node], x1 + 1) - evaluate(nodes[node], x0);
+        }
+        if (lo == hi) return countRow(image[lo], x0, x1);
+        int mid = (lo + hi) / 2;
+        return query(2 * node, lo, mid, y0, y1, x0, x1, image) +
+               query(2 * node + 1, mid + 1, hi, y0, y1, x0, x1, image);
+    }
+
+public:
+    // Drops everything; the tree is re-created on the next query
+    void reset() {
+        nodes.clear();
+        rows = 0;
+    }
+
+    // Row i changed: invalidate the nodes on its root-to-leaf path
+    void invalidateRow(int i) {
+        if (nodes.empty()) return;
+        int node = 1, lo = 0, hi = rows - 1;
+        while (true) {
+            nodes[node].valid = false;
+            if (lo == hi) break;
+            int mid = (lo + hi) / 2;
+            if (i <= mid) {
+                node = 2 * node;
+                hi = mid;
+            } else {
+                node = 2 * node + 1;
+                lo = mid + 1;
+            }
+        }
+    }
+
+    // Creates the tree on first use and rebuilds every node invalidated since
+    void build(const vector<Node*>& image) {
+        if (image.empty()) return;
+        if (nodes.empty()) {
+            rows = static_cast<int>(image.size());
+            nodes.resize(4 * static_cast<size_t>(rows));
+        }
+        ensure(1, 0, rows - 1, image);
+    }
+
+    // Black pixels in the inclusive rectangle [x0, x1] x [y0, y1]. Never writes,
+    // so concurrent queries are safe; before the first build every row is walked.
+    long long count(int x0, int y0, int x1, int y1, const vector<Node*>& image) const {
+        if (nodes.empty()) {
+            long long total = 0;
+            for (int i = y0; i <= y1; ++i) total += countRow(image[i], x0, x1);
+            return total;
+        }
+        return query(1, 0, rows - 1, y0, y1, x0, x1, image);
+    }
+};
+
 // Main Image Class
 class RunLengthImage : public CompressedImageInterface {
 private:
@@ -42,6 +368,95 @@ private:
     int height;
     int width;
 
+    // --- Cached Statistics ---
+    // Per-row black pixel and run counts, kept current by every path that
+    // rebuilds or edits a row. black_tree is a Fenwick tree over row_black.
+    vector<int> row_black;
+    vector<int> row_runs;
+    vector<long long> black_tree;
+    long long total_black = 0;
+    long long total_runs = 0;
+    CoverageIndex coverage; // Filled by buildCoverageIndex(), pruned by row edits
+
+    // Per-row run arrays for binary-search pixel lookups. Filled only by
+    // buildPixelIndex() and dropped whenever the row changes, so const lookups
+    // never write and concurrent readers are safe. Flags are chars, not the
+    // bit-packed vector<bool>, so neighbouring rows never share a word.
+    vector<RunList> run_index;
+    vector<char> run_index_valid;
+
+    void initStats() {
+        coverage.reset();
+        run_index.assign(height, RunList());
+        run_index_valid.assign(height, 0);
+        row_black.assign(height, 0);
+        row_runs.assign(height, 0);
+        black_tree.assign(height + 1, 0);
+        total_black = 0;
+        total_runs = 0;
+    }
+
+    // Row i's runs changed: drop its entries in the lookup indexes
+    void invalidateRowIndexes(int i) {
+        coverage.invalidateRow(i);
+        if (run_index_valid[i]) {
+            run_index_valid[i] = 0;
+            RunList().swap(run_index[i]);
+        }
+    }
+
+    // Whether column x lies inside one of row i's runs: binary search when the
+    // row is indexed, otherwise a walk down its list
+    bool rowContains(int i, int x) const {
+        if (run_index_valid[i]) return runsContain(run_index[i], x);
+        for (const Node* current = image[i]; current != nullptr && current->start_index <= x;
+             current = current->next) {
+            if (x <= current->end_index) return true;
+        }
+        return false;
+    }
+
+    // Whether column x lies inside one of the sorted runs, O(log runs)
+    static bool runsContain(const RunList& runs, int x) {
+        auto it = lower_bound(runs.begin(), runs.end(), x,
+                              [](const pair<int, int>& run, int column) { return run.second < column; });
+        return it != runs.end() && it->first <= x;
+    }
+
+    // Applies a change in row i's counts to the totals and the Fenwick tree.
+    // Every row edit passes through here, so it also invalidates the row indexes.
+    void adjustRowStats(int i, int black_delta, int runs_delta) {
+        invalidateRowIndexes(i);
+        row_black[i] += black_delta;
+        row_runs[i] += runs_delta;
+        total_black += black_delta;
+        total_runs += runs_delta;
+        if (black_delta == 0) return;
+        for (int k = i + 1; k <= height; k += k & -k) {
+            black_tree[k] += black_delta;
+        }
+    }
+
+    // Recounts row i after it has been rebuilt
+    void refreshRowStats(int i) {
+        int black = 0;
+        int runs = 0;
+        for (Node* current = image[i]; current != nullptr; current = current->next) {
+            black += current->end_index - current->start_index + 1;
+            ++runs;
+        }
+        adjustRowStats(i, black - row_black[i], runs - row_runs[i]);
+    }
+
+    // Sum of row_black[0..rows)
+    long long blackPrefix(int rows) const {
+        long long sum = 0;
+        for (int k = rows; k > 0; k -= k & -k) {
+            sum += black_tree[k];
+        }
+        return sum;
+    }
+
     // Helper to free memory for a single row
     void cleanup_row(int i) {
         Node* current = image[i];
@@ -103,11 +518,52 @@ private:
         }
 
         image[i] = head;
+        refreshRowStats(i);
     }
 
 public:
+    // Non-owning window onto a rectangle of an image. Runs are clipped and
+    // shifted on the fly, so the view can be used as a same-size operand
+    // without copying. The source must outlive the view and stay unmodified.
+    class SubImageView {
+    private:
+        const RunLengthImage* source;
+        int x0, y0, view_width, view_height;
+
+    public:
+        SubImageView(const RunLengthImage& src, int x, int y, int w, int h)
+            : source(&src), x0(x), y0(y), view_width(w), view_height(h) {
+            if (x < 0 || y < 0 || w < 0 || h < 0 || x + w > src.width || y + h > src.height) {
+                throw out_of_range("View rectangle out of range.");
+            }
+        }
+
+        int getWidth() const { return view_width; }
+        int getHeight() const { return view_height; }
+
+        // Calls visit(start, end) for each run of view row i, in view coordinates
+        template <typename Visit>
+        void forEachRun(int i, Visit visit) const {
+            if (i < 0 || i >= view_height) throw out_of_range("Row index out of range.");
+            if (view_width == 0) return;
+            int x1 = x0 + view_width - 1;
+            for (const Node* current = source->image[y0 + i]; current != nullptr; current = current->next) {
+                if (current->end_index < x0) continue;
+                if (current->start_index > x1) break;
+                visit(max(current->start_index, x0) - x0, min(current->end_index, x1) - x0);
+            }
+        }
+
+        RunList getRowRuns(int i) const {
+            RunList runs;
+            forEachRun(i, [&](int start, int end) { runs.emplace_back(start, end); });
+            return runs;
+        }
+    };
+
     RunLengthImage(const vector<vector<int>>& grid, int w, int h) : width(w), height(h) {
         image.resize(h);
+        initStats();
         for (int i = 0; i < h; i++) {
             // This loop performs the compression (CV Claim 2: Pixel grouping)
             Node* head = nullptr;
@@ -136,9 +592,21 @@ public:
                 if (tail != nullptr) tail->next = new_node;
             }
             image[i] = head;
+            refreshRowStats(i);
         }
     }
     
+    // Creates an all-white image of the given size
+    RunLengthImage(int w, int h) : height(h), width(w) {
+        if (w < 0 || h < 0) throw out_of_range("Image dimensions must be non-negative.");
+        image.assign(h, nullptr);
+        initStats();
+    }
+
+    // Rows own raw Node lists, so copying would double free them
+    RunLengthImage(const RunLengthImage&) = delete;
+    RunLengthImage& operator=(const RunLengthImage&) = delete;
+
     ~RunLengthImage() override {
         for (int i = 0; i < height; ++i) {
             cleanup_row(i);
@@ -167,6 +635,40 @@ public:
         }
     }
 
+    // Same as above with a sub-image view as the second operand
+    void performOperation(const SubImageView& view, function<bool(bool, bool)> op) {
+        if (this->width != view.getWidth() || this->height != view.getHeight()) {
+            throw BoundsMismatchException("Size of the two images do not match!");
+        }
+
+        for (int i = 0; i < height; i++) {
+            vector<bool> row1 = rowToGrid(i);
+            vector<bool> row2(width, true);
+            view.forEachRun(i, [&](int start, int end) {
+                for (int j = start; j <= end; ++j) row2[j] = false;
+            });
+
+            for (int j = 0; j < width; j++) {
+                row1[j] = op(row1[j], row2[j]);
+            }
+
+            cleanup_row(i);
+            reconstructRow(i, row1);
+        }
+    }
+
+    void performAnd(const SubImageView& view) {
+        performOperation(view, [](bool a, bool b){ return a && b; });
+    }
+
+    void performOr(const SubImageView& view) {
+        performOperation(view, [](bool a, bool b){ return a || b; });
+    }
+
+    void performXor(const SubImageView& view) {
+        performOperation(view, [](bool a, bool b){ return a ^ b; });
+    }
+
     void performAnd(CompressedImageInterface* img) override {
         performOperation(img, [](bool a, bool b){ return a && b; });
     }
@@ -193,86 +695,2273 @@ public:
 
     // Implementation of the virtual function
     string toStringCompressed() override {
-        stringstream ss;
-        ss << width << " " << height << ", ";
+        string result;
+        appendCompressed(result);
+        return result;
+    }
+
+    // --- Compressed Serialization ---
+    // All writers below emit exactly the same bytes as toStringCompressed:
+    // "W H, " then each row as "(s,e) " runs or " / ", rows joined by ","
+
+    // Exact number of bytes the compressed text form occupies
+    size_t compressedLength() {
+        CountingSink sink;
+        emitCompressed(sink);
+        return sink.count;
+    }
+
+    // Appends the compressed text to out, reserving the exact size up front
+    void appendCompressed(string& out) {
+        out.reserve(out.size() + compressedLength());
+        StringSink sink{out};
+        emitCompressed(sink);
+    }
+
+    // Writes into a caller-provided buffer (like snprintf, no terminator).
+    // Returns the full length; output is truncated if it exceeds capacity.
+    size_t serializeCompressed(char* buffer, size_t capacity) {
+        BufferSink sink{buffer, capacity, 0};
+        emitCompressed(sink);
+        return sink.count;
+    }
+
+    // Streams the compressed text straight to a file descriptor
+    void streamCompressed(int fd) {
+        FdSink sink(fd);
+        emitCompressed(sink);
+        sink.flush();
+    }
+
+    // Rebuilds an image from the toStringCompressed text without a dense grid.
+    // Runs must be in bounds and strictly increasing; touching runs are merged.
+    static unique_ptr<RunLengthImage> parseCompressed(const string& text) {
+        CompressedParser parser{text.data(), text.data() + text.size()};
+        int w = parser.readInt();
+        int h = parser.readInt();
+        if (w < 0 || h < 0) throw CompressedFormatException("Negative image dimensions.");
+        // Every row takes at least one byte, so a height beyond the text length
+        // cannot be honest; reject it before allocating the row slots
+        if (static_cast<size_t>(h) > text.size()) throw CompressedFormatException("Height exceeds the text length.");
+        parser.expect(',');
+
+        unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(w, h);
+        for (int i = 0; i < h; ++i) {
+            if (i > 0) parser.expect(',');
+            if (parser.peek() == '/') {
+                parser.expect('/');
+                continue;
+            }
+            Node* tail = nullptr;
+            do {
+                parser.expect('(');
+                int start = parser.readInt();
+                parser.expect(',');
+                int end = parser.readInt();
+                parser.expect(')');
+                if (start < 0 || end < start || end >= w) {
+                    throw CompressedFormatException("Run out of bounds in row " + to_string(i) + ".");
+                }
+                if (tail != nullptr && start <= tail->end_index) {
+                    throw CompressedFormatException("Runs overlap or are unsorted in row " + to_string(i) + ".");
+                }
+                if (tail != nullptr && start == tail->end_index + 1) {
+                    tail->end_index = end; // Keep the row canonical
+                } else {
+                    Node* new_node = new Node(start, end);
+                    if (tail == nullptr) result->image[i] = new_node;
+                    else tail->next = new_node;
+                    tail = new_node;
+                }
+            } while (parser.peek() == '(');
+            result->refreshRowStats(i);
+        }
+        if (parser.peek() != '\0') throw CompressedFormatException("Unexpected trailing data.");
+        return result;
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // Read-only access to row i's runs, for algorithms that walk the lists directly
+    const Node* rowHead(int i) const {
+        if (i < 0 || i >= height) throw out_of_range("Row index out of range.");
+        return image[i];
+    }
+
+    // --- Translation ---
+
+    // Moves the image content by (dx, dy), clipping at the borders. Row lists are
+    // moved between slots rather than copied, and runs are offset in place.
+    void translate(int dx, int dy) {
+        if (dy != 0) {
+            vector<Node*> moved(height, nullptr);
+            for (int i = 0; i < height; ++i) {
+                long long target = static_cast<long long>(i) + dy;
+                if (target >= 0 && target < height) {
+                    moved[target] = image[i];
+                    image[i] = nullptr;
+                } else {
+                    cleanup_row(i);
+                }
+            }
+            image.swap(moved);
+        }
+        if (dx != 0) {
+            for (int i = 0; i < height; ++i) {
+                Node** link = &image[i];
+                while (*link != nullptr) {
+                    Node* current = *link;
+                    long long start = static_cast<long long>(current->start_index) + dx;
+                    long long end = static_cast<long long>(current->end_index) + dx;
+                    if (end < 0 || start >= width) {
+                        *link = current->next;
+                        delete current;
+                        continue;
+                    }
+                    current->start_index = static_cast<int>(max(0LL, start));
+                    current->end_index = static_cast<int>(min(static_cast<long long>(width) - 1, end));
+                    link = &current->next;
+                }
+            }
+        }
+        initStats();
+        for (int i = 0; i < height; ++i) refreshRowStats(i);
+    }
+
+    // Calls visit(start, end) for each run of other's row (y - dy) moved right by dx
+    // and clipped to this image's width, i.e. other translated by (dx, dy) at row y
+    template <typename Visit>
+    void forEachShiftedRun(const RunLengthImage& other, int dx, int dy, int y, Visit visit) const {
+        long long source_row = static_cast<long long>(y) - dy;
+        if (source_row < 0 || source_row >= other.height) return;
+        for (const Node* current = other.image[source_row]; current != nullptr; current = current->next) {
+            long long start = max(0LL, static_cast<long long>(current->start_index) + dx);
+            long long end = min(static_cast<long long>(width) - 1, static_cast<long long>(current->end_index) + dx);
+            if (start > end) continue;
+            visit(static_cast<int>(start), static_cast<int>(end));
+        }
+    }
+
+    // Same result as performXor against other translated by (dx, dy), without
+    // building the translated image. Like performXor, this XORs pixel values
+    // (1 = white), so a pixel ends up black where both inputs agree.
+    void performXor(const RunLengthImage& other, int dx, int dy) {
+        if (this->width != other.width || this->height != other.height) {
+            throw BoundsMismatchException("Size of the two images do not match!");
+        }
+        RunList shifted;
+        for (int i = 0; i < height; ++i) {
+            shifted.clear();
+            forEachShiftedRun(other, dx, dy, i, [&](int start, int end) { shifted.emplace_back(start, end); });
+            setRowRuns(i, complementRuns(xorRuns(getRowRuns(i), shifted), width));
+        }
+    }
+
+    // --- Flips and Rotations ---
+
+    // Mirrors left-right in place: each row list is reversed and its runs mirrored
+    void flipHorizontal() {
         for (int i = 0; i < height; ++i) {
+            Node* reversed = nullptr;
             Node* current = image[i];
-            if (current == nullptr) {
-                ss << " / "; // Represent all-white row
-            } else {
-                while (current != nullptr) {
-                    ss << "(" << current->start_index << "," << current->end_index << ") ";
-                    current = current->next;
+            while (current != nullptr) {
+                Node* next_node = current->next;
+                int start = current->start_index;
+                current->start_index = width - 1 - current->end_index;
+                current->end_index = width - 1 - start;
+                current->next = reversed;
+                reversed = current;
+                current = next_node;
+            }
+            image[i] = reversed;
+            invalidateRowIndexes(i); // Counts are unchanged but positions moved
+        }
+    }
+
+    // Mirrors top-bottom in place by reversing the row table
+    void flipVertical() {
+        reverse(image.begin(), image.end());
+        initStats();
+        for (int i = 0; i < height; ++i) refreshRowStats(i);
+    }
+
+    void rotate180() {
+        flipHorizontal();
+        flipVertical();
+    }
+
+    // Returns the height x width transpose. Rows are swept top to bottom and only
+    // the columns where consecutive rows differ (their XOR runs) open or close an
+    // output run, so the cost is O(input runs + output runs), never O(pixels).
+    unique_ptr<RunLengthImage> transpose() const {
+        vector<RunList> columns(width);
+        vector<int> open_since(width, -1);
+        RunList previous;
+        for (int i = 0; i <= height; ++i) {
+            RunList current = (i < height) ? getRowRuns(i) : RunList();
+            for (const pair<int, int>& change : xorRuns(previous, current)) {
+                for (int x = change.first; x <= change.second; ++x) {
+                    if (open_since[x] == -1) {
+                        open_since[x] = i;
+                    } else {
+                        columns[x].emplace_back(open_since[x], i - 1);
+                        open_since[x] = -1;
+                    }
                 }
             }
-            ss << ",";
+            previous.swap(current);
         }
-        string result = ss.str();
-        // Remove trailing comma and space
-        if (result.length() > 2) {
-            return result.substr(0, result.length() - 1);
+        unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(height, width);
+        for (int x = 0; x < width; ++x) {
+            result->setRowRuns(x, columns[x]);
         }
         return result;
     }
-};
 
-// Helper function to convert raw string data into a 2D grid
-vector<vector<int>> parseImageString(const string& raw_data, int& w, int& h) {
-    stringstream ss(raw_data);
-    
-    // Read dimensions (w, h)
-    ss >> w >> h;
-    
-    vector<vector<int>> grid(h, vector<int>(w));
-    
-    for (int i = 0; i < h; ++i) {
-        for (int j = 0; j < w; ++j) {
-            // Read 0 or 1 for pixel value
-            ss >> grid[i][j];
-        }
+    // Returns the image rotated 90 degrees clockwise
+    unique_ptr<RunLengthImage> rotate90() const {
+        unique_ptr<RunLengthImage> result = transpose();
+        result->flipHorizontal();
+        return result;
     }
-    return grid;
-}
 
+    // Returns the image rotated 90 degrees counter-clockwise
+    unique_ptr<RunLengthImage> rotate270() const {
+        unique_ptr<RunLengthImage> result = transpose();
+        result->flipVertical();
+        return result;
+    }
 
-int main() {
-    // Large 16x16 image data (from your previous input)
-    const string RAW_IMAGE_DATA = 
-        "16 16\n"
-        "1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 1\n"
-        "1 1 1 1 1 0 0 0 1 1 1 1 1 1 1 1\n"
-        "1 1 1 0 0 0 0 0 1 1 1 1 1 1 1 1\n"
-        "1 1 0 0 0 0 0 0 1 1 1 1 1 1 1 1\n"
-        "1 1 0 1 1 1 0 0 1 1 1 1 1 1 1 1\n"
-        "1 1 1 1 1 1 0 0 1 1 1 1 1 1 1 1\n"
-        "1 1 1 1 1 1 0 0 1 1 1 1 1 1 1 1\n"
-        "1 1 1 1 0 0 0 1 1 1 1 1 1 1 1 1\n"
-        "1 1 0 0 0 1 1 1 1 1 1 1 1 1 1 1\n"
-        "1 1 0 0 1 1 1 1 1 1 1 1 1 1 0 0\n"
-        "1 1 0 1 1 1 1 1 1 1 1 1 1 0 0 0\n"
-        "1 1 1 1 1 1 1 1 1 1 1 0 0 0 1 1\n"
-        "1 1 1 1 1 1 1 1 1 1 1 0 0 1 1 1\n"
-        "1 1 1 1 1 1 1 1 1 1 0 0 1 1 1 1\n"
-        "1 1 1 1 1 1 1 1 1 0 0 1 1 1 1 1\n"
-        "1 1 1 1 1 1 1 0 0 0 1 1 1 1 1 1";
+    // --- Downsampling ---
 
-    // FIX 2: Declare w and h before use
-    int w = 0, h = 0;
-    vector<vector<int>> initial_grid = parseImageString(RAW_IMAGE_DATA, w, h);
+    // How a factor x factor block of black/white pixels collapses to one pixel
+    enum class Reduction { AnyBlack, AllBlack, Majority };
 
-    cout << "--- Initializing 16x16 Compressed Images ---" << endl;
+    // Returns a ceil(width / factor) x ceil(height / factor) image. Each band of
+    // factor rows is folded into one run list (union, intersection or per-block
+    // counts) and runs are mapped to block indices, so work is O(runs + output runs).
+    // Edge blocks use only the pixels that exist.
+    unique_ptr<RunLengthImage> downsample(int factor, Reduction mode) const {
+        if (factor <= 0) throw out_of_range("Downsampling factor must be positive.");
+        // Ceiling division written so that factors near INT_MAX cannot overflow
+        int out_width = width / factor + (width % factor != 0);
+        int out_height = height / factor + (height % factor != 0);
+        unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(out_width, out_height);
+        vector<long long> block_black(out_width, 0);
 
-    // Img1: The original image
-    unique_ptr<CompressedImageInterface> img1 = make_unique<RunLengthImage>(initial_grid, w, h);
-    cout << "Img1 Compressed (Initial): " << img1->toStringCompressed() << "\n\n";
+        for (int by = 0; by < out_height; ++by) {
+            int top = by * factor;
+            int bottom = static_cast<int>(min<long long>(height, static_cast<long long>(top) + factor));
+            RunList out;
+            if (mode == Reduction::AnyBlack) {
+                RunList band;
+                for (int i = top; i < bottom; ++i) band = unionRuns(band, getRowRuns(i));
+                for (const pair<int, int>& run : band) appendMerged(out, run.first / factor, run.second / factor);
+            } else if (mode == Reduction::AllBlack) {
+                RunList band = getRowRuns(top);
+                for (int i = top + 1; i < bottom; ++i) band = intersectRuns(band, getRowRuns(i));
+                for (const pair<int, int>& run : band) {
+                    // Blocks lying entirely inside the run; an edge block ends at width - 1
+                    int first = run.first / factor + (run.first % factor != 0);
+                    int last = (run.second == width - 1) ? out_width - 1 : (run.second + 1) / factor - 1;
+                    if (first <= last) appendMerged(out, first, last);
+                }
+            } else {
+                RunList touched;
+                for (int i = top; i < bottom; ++i) {
+                    for (const Node* current = image[i]; current != nullptr; current = current->next) {
+                        int first = current->start_index / factor;
+                        int last = current->end_index / factor;
+                        for (int bx = first; bx <= last; ++bx) {
+                            long long block_first = static_cast<long long>(bx) * factor;
+                            int block_start = max(current->start_index, static_cast<int>(block_first));
+                            int block_end = static_cast<int>(min<long long>(current->end_index, block_first + factor - 1));
+                            block_black[bx] += block_end - block_start + 1;
+                        }
+                    }
+                }
+                RunList band;
+                for (int i = top; i < bottom; ++i) band = unionRuns(band, getRowRuns(i));
+                for (const pair<int, int>& run : band) appendMerged(touched, run.first / factor, run.second / factor);
+                for (const pair<int, int>& blocks : touched) {
+                    for (int bx = blocks.first; bx <= blocks.second; ++bx) {
+                        long long block_first = static_cast<long long>(bx) * factor;
+                        long long area = (min<long long>(width, block_first + factor) - block_first) * (bottom - top);
+                        if (2 * block_black[bx] > area) appendMerged(out, bx, bx);
+                        block_black[bx] = 0;
+                    }
+                }
+            }
+            result->setRowRuns(by, out);
+        }
+        return result;
+    }
 
-    // Img2: A copy that will be inverted
-    unique_ptr<CompressedImageInterface> img2 = make_unique<RunLengthImage>(initial_grid, w, h);
-    img2->invert();
-    cout << "Img2 Compressed (Inverted): " << img2->toStringCompressed() << "\n\n";
-    
-    // Test 1: XOR Operation
-    cout << "--- Testing XOR (Img1 ^ Img2) ---" << endl;
+    // --- Nearest-Neighbour Scaling ---
+
+    // Returns the image resampled to new_width x new_height: output pixel (x, y)
+    // takes source pixel (x * width / new_width, y * height / new_height). Run
+    // endpoints are mapped directly, and each source row is scaled once and reused
+    // for every output row it repeats into, so work is O(output runs).
+    unique_ptr<RunLengthImage> resize(int new_width, int new_height) const {
+        if (new_width < 0 || new_height < 0) throw out_of_range("Image dimensions must be non-negative.");
+        unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(new_width, new_height);
+        if (new_width == 0 || new_height == 0) return result; // No pixels to sample
+        if (width == 0 || height == 0) throw out_of_range("Cannot resample an empty image.");
+        RunList scaled;
+        int scaled_source = -1;
+        for (int y = 0; y < new_height; ++y) {
+            int source_row = static_cast<int>(static_cast<long long>(y) * height / new_height);
+            if (source_row != scaled_source) {
+                scaled.clear();
+                for (const Node* current = image[source_row]; current != nullptr; current = current->next) {
+                    // Output columns whose source column falls inside [start, end]
+                    long long first = (static_cast<long long>(current->start_index) * new_width + width - 1) / width;
+                    long long last = ((current->end_index + 1LL) * new_width + width - 1) / width - 1;
+                    if (first <= last) appendMerged(scaled, static_cast<int>(first), static_cast<int>(last));
+                }
+                scaled_source = source_row;
+            }
+            result->setRowRuns(y, scaled);
+        }
+        return result;
+    }
+
+    // Integer upscaling: every pixel becomes a factor x factor block
+    unique_ptr<RunLengthImage> upscale(int factor) const {
+        if (factor <= 0) throw out_of_range("Scaling factor must be positive.");
+        return resize(checkedDimension(static_cast<double>(width) * factor),
+                      checkedDimension(static_cast<double>(height) * factor));
+    }
+
+    // Fractional scaling; output dimensions are rounded to the nearest pixel
+    unique_ptr<RunLengthImage> scale(double scale_x, double scale_y) const {
+        if (!(scale_x > 0) || !(scale_y > 0)) throw out_of_range("Scaling factor must be positive.");
+        return resize(checkedDimension(width * scale_x + 0.5), checkedDimension(height * scale_y + 0.5));
+    }
+
+    // --- Flood Fill ---
+
+    // Returns, as black pixels of a new image, the connected region of the seed's
+    // color (black or white) containing (x, y). Works on maximal same-colored
+    // spans with a span stack; spans of a row are only materialized when the fill
+    // reaches that row, and visited flags are kept per span, not per pixel.
+    unique_ptr<RunLengthImage> regionAt(int x, int y, int connectivity) const {
+        unordered_map<int, RunList> region = regionSpans(x, y, connectivity);
+        unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(width, height);
+        for (pair<const int, RunList>& row : region) {
+            sort(row.second.begin(), row.second.end());
+            result->setRowRuns(row.first, row.second);
+        }
+        return result;
+    }
+
+    // Bucket fill: repaints the region containing (x, y) with color (0 black, else white)
+    void floodFill(int x, int y, int color, int connectivity) {
+        unordered_map<int, RunList> region = regionSpans(x, y, connectivity);
+        for (const pair<const int, RunList>& row : region) {
+            for (const pair<int, int>& span : row.second) setSpan(row.first, span.first, span.second, color);
+        }
+    }
+
+    // --- Region of Interest ---
+
+    SubImageView subImage(int x, int y, int w, int h) const {
+        return SubImageView(*this, x, y, w, h);
+    }
+
+    // Copies the rectangle into a new image; only runs in the cropped rows are visited
+    unique_ptr<RunLengthImage> crop(int x, int y, int w, int h) const {
+        SubImageView view(*this, x, y, w, h);
+        unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(w, h);
+        for (int i = 0; i < h; ++i) {
+            result->setRowRuns(i, view.getRowRuns(i));
+        }
+        return result;
+    }
+
+    // --- Statistics ---
+    // Served from the per-row cache; no row list is walked.
+
+    long long blackPixelCount() const { return total_black; }
+    long long runCount() const { return total_runs; }
+    bool isEmpty() const { return total_black == 0; }
+
+    // Fraction of pixels that are black
+    double density() const {
+        long long area = static_cast<long long>(width) * height;
+        return area == 0 ? 0.0 : static_cast<double>(total_black) / area;
+    }
+
+    int rowBlackCount(int i) const {
+        if (i < 0 || i >= height) throw out_of_range("Row index out of range.");
+        return row_black[i];
+    }
+
+    int rowRunCount(int i) const {
+        if (i < 0 || i >= height) throw out_of_range("Row index out of range.");
+        return row_runs[i];
+    }
+
+    // Black pixels in rows y0..y1 inclusive, O(log height)
+    long long blackPixelsInRows(int y0, int y1) const {
+        if (y0 < 0 || y1 >= height || y0 > y1) throw out_of_range("Row range out of range.");
+        return blackPrefix(y1 + 1) - blackPrefix(y0);
+    }
+
+    // Builds (or refreshes after edits) the coverage index for rectangle counts
+    void buildCoverageIndex() { coverage.build(image); }
+
+    // Black pixels in the inclusive rectangle [x0, x1] x [y0, y1], answered in
+    // O(log^2) from the coverage index. Rows edited since the last build are
+    // counted from their lists. Read-only, so concurrent queries are safe.
+    long long blackPixelsInRect(int x0, int y0, int x1, int y1) const {
+        if (x0 < 0 || x1 >= width || x0 > x1 || y0 < 0 || y1 >= height || y0 > y1) {
+            throw out_of_range("Rectangle out of range.");
+        }
+        return coverage.count(x0, y0, x1, y1, image);
+    }
+
+    // Fraction of the rectangle that is black
+    double rectCoverage(int x0, int y0, int x1, int y1) const {
+        long long area = static_cast<long long>(x1 - x0 + 1) * (y1 - y0 + 1);
+        return static_cast<double>(blackPixelsInRect(x0, y0, x1, y1)) / area;
+    }
+
+    // --- Pixel Queries ---
+
+    // Copies every row's runs into arrays for binary-search lookups. Rows edited
+    // afterwards fall back to their lists until this is called again.
+    void buildPixelIndex() {
+        for (int i = 0; i < height; ++i) {
+            if (run_index_valid[i]) continue;
+            run_index[i] = getRowRuns(i);
+            run_index_valid[i] = 1;
+        }
+    }
+
+    // Returns the pixel at column x, row y: 0 for black, 1 for white.
+    // O(log runs) on rows covered by buildPixelIndex(). Read-only, so any
+    // number of threads may query an image that nobody is editing.
+    int getPixel(int x, int y) const {
+        if (x < 0 || x >= width) throw out_of_range("Column index out of range.");
+        if (y < 0 || y >= height) throw out_of_range("Row index out of range.");
+        return rowContains(y, x) ? 0 : 1;
+    }
+
+    // Batched getPixel over (x, y) points; results are in input order.
+    // Points are visited sorted by row then column, so each row's run array is
+    // fetched once (from the index, or copied locally for unindexed rows) and
+    // consecutive lookups stay in the same cache lines.
+    vector<int> getPixels(const vector<pair<int, int>>& points) const {
+        vector<int> order(points.size());
+        for (size_t k = 0; k < order.size(); ++k) {
+            const pair<int, int>& p = points[k];
+            if (p.first < 0 || p.first >= width) throw out_of_range("Column index out of range.");
+            if (p.second < 0 || p.second >= height) throw out_of_range("Row index out of range.");
+            order[k] = static_cast<int>(k);
+        }
+        sort(order.begin(), order.end(), [&](int a, int b) {
+            if (points[a].second != points[b].second) return points[a].second < points[b].second;
+            return points[a].first < points[b].first;
+        });
+
+        vector<int> result(points.size(), 1);
+        int current_row = -1;
+        RunList local_runs;
+        const RunList* runs = nullptr;
+        for (int k : order) {
+            int y = points[k].second;
+            if (y != current_row) {
+                current_row = y;
+                if (run_index_valid[y]) {
+                    runs = &run_index[y];
+                } else {
+                    local_runs = getRowRuns(y);
+                    runs = &local_runs;
+                }
+            }
+            if (runsContain(*runs, points[k].first)) result[k] = 0;
+        }
+        return result;
+    }
+
+    // --- Incremental Editing ---
+    // color follows the input format: 0 paints black, anything else paints white.
+    // Only the runs touching the span are split, merged or removed.
+
+    void setSpan(int y, int x0, int x1, int color) {
+        if (y < 0 || y >= height) throw out_of_range("Row index out of range.");
+        if (x0 < 0 || x1 >= width || x0 > x1) throw out_of_range("Span out of range.");
+
+        Node** link = &image[y];
+        if (color == 0) {
+            // Absorb every run overlapping or touching [x0, x1] into one node
+            while (*link != nullptr && (*link)->end_index < x0 - 1) link = &(*link)->next;
+            int start = x0;
+            int end = x1;
+            int black_delta = 0;
+            int runs_delta = 1;
+            while (*link != nullptr && (*link)->start_index <= x1 + 1) {
+                Node* absorbed = *link;
+                start = min(start, absorbed->start_index);
+                end = max(end, absorbed->end_index);
+                black_delta -= absorbed->end_index - absorbed->start_index + 1;
+                --runs_delta;
+                *link = absorbed->next;
+                delete absorbed;
+            }
+            Node* new_node = new Node(start, end);
+            new_node->next = *link;
+            *link = new_node;
+            adjustRowStats(y, black_delta + (end - start + 1), runs_delta);
+            return;
+        }
+
+        // Carve [x0, x1] out of the overlapping runs
+        while (*link != nullptr && (*link)->end_index < x0) link = &(*link)->next;
+        while (*link != nullptr && (*link)->start_index <= x1) {
+            Node* current = *link;
+            if (current->start_index < x0 && current->end_index > x1) {
+                Node* right = new Node(x1 + 1, current->end_index);
+                right->next = current->next;
+                current->end_index = x0 - 1;
+                current->next = right;
+                adjustRowStats(y, -(x1 - x0 + 1), 1);
+                return;
+            }
+            if (current->start_index < x0) {
+                adjustRowStats(y, -(current->end_index - x0 + 1), 0);
+                current->end_index = x0 - 1;
+                link = &current->next;
+            } else if (current->end_index > x1) {
+                adjustRowStats(y, -(x1 - current->start_index + 1), 0);
+                current->start_index = x1 + 1;
+                return;
+            } else {
+                adjustRowStats(y, -(current->end_index - current->start_index + 1), -1);
+                *link = current->next;
+                delete current;
+            }
+        }
+    }
+
+    void setPixel(int x, int y, int color) {
+        setSpan(y, x, x, color);
+    }
+
+    // Paints the inclusive rectangle [x0, x1] x [y0, y1]
+    void fillRect(int x0, int y0, int x1, int y1, int color) {
+        if (y0 < 0 || y1 >= height || y0 > y1) throw out_of_range("Rectangle out of range.");
+        for (int y = y0; y <= y1; ++y) {
+            setSpan(y, x0, x1, color);
+        }
+    }
+
+    // --- Morphology ---
+    // Black is foreground. Rectangular kernels are anchored at (w / 2, h / 2)
+    // and run as a horizontal pass on runs followed by a vertical pass over rows.
+    // Pixels outside the image count as white for dilation and black for erosion.
+
+    void dilate(int kernel_width, int kernel_height) {
+        checkKernel(kernel_width, kernel_height);
+        int left = min(kernel_width / 2, width), right = min(kernel_width - 1 - kernel_width / 2, width);
+        int up = kernel_height / 2, down = kernel_height - 1 - up;
+        vector<RunList> rows(height);
+        for (int i = 0; i < height; ++i) rows[i] = dilateRuns(getRowRuns(i), -left, right, width);
+        replaceRows(slidingRows(rows, down, up, true));
+    }
+
+    void erode(int kernel_width, int kernel_height) {
+        checkKernel(kernel_width, kernel_height);
+        int left = min(kernel_width / 2, width), right = min(kernel_width - 1 - kernel_width / 2, width);
+        int up = kernel_height / 2, down = kernel_height - 1 - up;
+        vector<RunList> rows(height);
+        for (int i = 0; i < height; ++i) rows[i] = erodeRuns(getRowRuns(i), -left, right, width);
+        replaceRows(slidingRows(rows, up, down, false));
+    }
+
+    void open(int kernel_width, int kernel_height) {
+        erode(kernel_width, kernel_height);
+        dilate(kernel_width, kernel_height);
+    }
+
+    void close(int kernel_width, int kernel_height) {
+        dilate(kernel_width, kernel_height);
+        erode(kernel_width, kernel_height);
+    }
+
+    // Arbitrary structuring element: the black pixels of se, with (anchor_x, anchor_y)
+    // as its origin. Each run of se contributes one shifted interval dilation of the rows.
+    void dilate(const RunLengthImage& se, int anchor_x, int anchor_y) {
+        vector<RunList> source = allRowRuns();
+        vector<RunList> rows(height);
+        for (int sy = 0; sy < se.height; ++sy) {
+            int dy = sy - anchor_y;
+            for (const Node* run = se.image[sy]; run != nullptr; run = run->next) {
+                for (int i = max(0, dy); i < min(height, height + dy); ++i) {
+                    rows[i] = unionRuns(rows[i], dilateRuns(source[i - dy], run->start_index - anchor_x,
+                                                            run->end_index - anchor_x, width));
+                }
+            }
+        }
+        replaceRows(rows);
+    }
+
+    void erode(const RunLengthImage& se, int anchor_x, int anchor_y) {
+        vector<RunList> source = allRowRuns();
+        RunList full;
+        if (width > 0) full.emplace_back(0, width - 1);
+        vector<RunList> rows(height, full);
+        for (int sy = 0; sy < se.height; ++sy) {
+            int dy = sy - anchor_y;
+            for (const Node* run = se.image[sy]; run != nullptr; run = run->next) {
+                for (int i = max(0, -dy); i < min(height, height - dy); ++i) {
+                    rows[i] = intersectRuns(rows[i], erodeRuns(source[i + dy], run->start_index - anchor_x,
+                                                               run->end_index - anchor_x, width));
+                }
+            }
+        }
+        replaceRows(rows);
+    }
+
+    void open(const RunLengthImage& se, int anchor_x, int anchor_y) {
+        erode(se, anchor_x, anchor_y);
+        dilate(se, anchor_x, anchor_y);
+    }
+
+    void close(const RunLengthImage& se, int anchor_x, int anchor_y) {
+        dilate(se, anchor_x, anchor_y);
+        erode(se, anchor_x, anchor_y);
+    }
+
+    RunList getRowRuns(int i) const {
+        RunList runs;
+        runs.reserve(rowRunCount(i));
+        for (const Node* current = image[i]; current != nullptr; current = current->next) {
+            runs.emplace_back(current->start_index, current->end_index);
+        }
+        return runs;
+    }
+
+    // Replaces row i with the given [start, end] runs. Runs must be in bounds
+    // and strictly increasing; touching runs are merged to keep the row canonical.
+    void setRowRuns(int i, const vector<pair<int, int>>& runs) {
+        if (i < 0 || i >= height) throw out_of_range("Row index out of range.");
+        int previous_end = -2;
+        for (const pair<int, int>& run : runs) {
+            if (run.first < 0 || run.second < run.first || run.second >= width) {
+                throw out_of_range("Run out of bounds in row " + to_string(i) + ".");
+            }
+            if (run.first <= previous_end) {
+                throw invalid_argument("Runs overlap or are unsorted in row " + to_string(i) + ".");
+            }
+            previous_end = run.second;
+        }
+        cleanup_row(i);
+        Node* tail = nullptr;
+        for (const pair<int, int>& run : runs) {
+            if (tail != nullptr && run.first == tail->end_index + 1) {
+                tail->end_index = run.second;
+                continue;
+            }
+            Node* new_node = new Node(run.first, run.second);
+            if (tail == nullptr) image[i] = new_node;
+            else tail->next = new_node;
+            tail = new_node;
+        }
+        refreshRowStats(i);
+    }
+
+    // --- Grayscale Ingestion ---
+    // Reads an 8-bit PGM (P2 or P5) row by row, encoding pixels at or below
+    // the threshold as black runs without building a dense binary grid.
+    static unique_ptr<RunLengthImage> fromPGM(istream& in, int threshold) {
+        PGMReader reader(in);
+        unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(reader.width, reader.height);
+        vector<unsigned char> row(reader.width);
+        for (int i = 0; i < reader.height; ++i) {
+            reader.readRow(row.data());
+            result->buildRow(i, [&](int j) { return row[j] <= threshold; });
+        }
+        return result;
+    }
+
+    // Same as fromPGM, but each tile_size x tile_size tile gets its own Otsu
+    // threshold. Only one band of tile_size rows is held in memory at a time.
+    static unique_ptr<RunLengthImage> fromPGMOtsu(istream& in, int tile_size) {
+        if (tile_size <= 0) throw out_of_range("Tile size must be positive.");
+        PGMReader reader(in);
+        int w = reader.width;
+        unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(w, reader.height);
+        int tiles_across = (w + tile_size - 1) / tile_size;
+        vector<unsigned char> band(static_cast<size_t>(tile_size) * w);
+        vector<int> thresholds(tiles_across);
+
+        for (int band_top = 0; band_top < reader.height; band_top += tile_size) {
+            int band_rows = min(tile_size, reader.height - band_top);
+            for (int r = 0; r < band_rows; ++r) {
+                reader.readRow(band.data() + static_cast<size_t>(r) * w);
+            }
+            for (int t = 0; t < tiles_across; ++t) {
+                int x0 = t * tile_size;
+                int x1 = min(w, x0 + tile_size);
+                int histogram[256] = {0};
+                for (int r = 0; r < band_rows; ++r) {
+                    const unsigned char* row = band.data() + static_cast<size_t>(r) * w;
+                    for (int j = x0; j < x1; ++j) histogram[row[j]]++;
+                }
+                thresholds[t] = otsuThreshold(histogram);
+            }
+            for (int r = 0; r < band_rows; ++r) {
+                const unsigned char* row = band.data() + static_cast<size_t>(r) * w;
+                result->buildRow(band_top + r, [&](int j) { return row[j] <= thresholds[j / tile_size]; });
+            }
+        }
+        return result;
+    }
+
+    // Threshold maximising between-class variance; values <= result are the dark class
+    static int otsuThreshold(const int histogram[256]) {
+        long long total = 0;
+        double weighted_total = 0;
+        for (int v = 0; v < 256; ++v) {
+            total += histogram[v];
+            weighted_total += static_cast<double>(v) * histogram[v];
+        }
+        long long dark_count = 0;
+        double dark_sum = 0;
+        double best_variance = -1;
+        int best = 0;
+        for (int t = 0; t < 256; ++t) {
+            dark_count += histogram[t];
+            dark_sum += static_cast<double>(t) * histogram[t];
+            long long light_count = total - dark_count;
+            if (dark_count == 0 || light_count == 0) continue;
+            double dark_mean = dark_sum / dark_count;
+            double light_mean = (weighted_total - dark_sum) / light_count;
+            double variance = static_cast<double>(dark_count) * light_count * (dark_mean - light_mean) * (dark_mean - light_mean);
+            if (variance > best_variance) {
+                best_variance = variance;
+                best = t;
+            }
+        }
+        return best;
+    }
+
+private:
+    // Spans (unsorted per row) of the region grown from (x, y) for flood fill,
+    // keyed by row. Only rows the fill touches get an entry, so the cost follows
+    // the region's size rather than the image height.
+    unordered_map<int, RunList> regionSpans(int x, int y, int connectivity) const {
+        if (connectivity != 4 && connectivity != 8) throw invalid_argument("Connectivity must be 4 or 8.");
+        bool black = getPixel(x, y) == 0;
+        int reach = (connectivity == 8) ? 1 : 0;
+
+        struct RowSpans {
+            RunList spans;
+            vector<bool> visited;
+        };
+        unordered_map<int, RowSpans> loaded;
+        auto load = [&](int i) -> RowSpans& {
+            auto found = loaded.find(i);
+            if (found != loaded.end()) return found->second;
+            RowSpans& row = loaded[i];
+            row.spans = black ? getRowRuns(i) : complementRuns(getRowRuns(i), width);
+            row.visited.assign(row.spans.size(), false);
+            return row;
+        };
+
+        unordered_map<int, RunList> region;
+        RowSpans& seed_row = load(y);
+        // The span containing the seed: first span ending at or after x
+        auto seed = lower_bound(seed_row.spans.begin(), seed_row.spans.end(), x,
+                                [](const pair<int, int>& span, int column) { return span.second < column; });
+        vector<pair<int, int>> stack{{y, static_cast<int>(seed - seed_row.spans.begin())}};
+        seed_row.visited[stack.back().second] = true;
+
+        while (!stack.empty()) {
+            int row = stack.back().first;
+            pair<int, int> span = loaded[row].spans[stack.back().second];
+            stack.pop_back();
+            region[row].push_back(span);
+            for (int neighbour = row - 1; neighbour <= row + 1; neighbour += 2) {
+                if (neighbour < 0 || neighbour >= height) continue;
+                RowSpans& candidates = load(neighbour);
+                auto it = lower_bound(candidates.spans.begin(), candidates.spans.end(), span.first - reach,
+                                      [](const pair<int, int>& c, int column) { return c.second < column; });
+                for (; it != candidates.spans.end() && it->first <= span.second + reach; ++it) {
+                    int k = static_cast<int>(it - candidates.spans.begin());
+                    if (candidates.visited[k]) continue;
+                    candidates.visited[k] = true;
+                    stack.emplace_back(neighbour, k);
+                }
+            }
+        }
+        return region;
+    }
+
+    // Output size computed in double, checked before narrowing to int
+    static int checkedDimension(double size) {
+        if (!(size <= INT_MAX)) throw out_of_range("Scaled image dimensions are too large.");
+        return static_cast<int>(size);
+    }
+
+    static void checkKernel(int kernel_width, int kernel_height) {
+        if (kernel_width <= 0 || kernel_height <= 0) throw out_of_range("Kernel size must be positive.");
+    }
+
+    vector<RunList> allRowRuns() const {
+        vector<RunList> rows(height);
+        for (int i = 0; i < height; ++i) rows[i] = getRowRuns(i);
+        return rows;
+    }
+
+    void replaceRows(const vector<RunList>& rows) {
+        for (int i = 0; i < height; ++i) setRowRuns(i, rows[i]);
+    }
+
+    // out[i] = union (or intersection) of rows[i - before .. i + after]; rows
+    // outside the image are the identity (empty for union, full for intersection).
+    // Large windows use van Herk/Gil-Werman block prefix/suffix combining, so
+    // each output row costs two row operations regardless of window height.
+    vector<RunList> slidingRows(const vector<RunList>& rows, int before, int after, bool use_union) const {
+        RunList identity;
+        if (!use_union && width > 0) identity.emplace_back(0, width - 1);
+        auto combine = [&](const RunList& a, const RunList& b) {
+            return use_union ? unionRuns(a, b) : intersectRuns(a, b);
+        };
+        // Reaching further than the image is tall adds nothing, and keeps the
+        // padded buffers below proportional to height rather than the kernel.
+        before = min(before, max(height - 1, 0));
+        after = min(after, max(height - 1, 0));
+        int window = before + after + 1;
+        vector<RunList> out(height);
+        if (window <= 3) {
+            for (int i = 0; i < height; ++i) {
+                RunList acc = identity;
+                for (int r = i - before; r <= i + after; ++r) {
+                    if (r >= 0 && r < height) acc = combine(acc, rows[r]);
+                }
+                out[i] = acc;
+            }
+            return out;
+        }
+
+        int padded = height + window - 1;
+        auto at = [&](int t) -> const RunList& {
+            int r = t - before;
+            return (r >= 0 && r < height) ? rows[r] : identity;
+        };
+        vector<RunList> prefix(padded);
+        vector<RunList> suffix(padded);
+        for (int t = 0; t < padded; ++t) {
+            prefix[t] = (t % window == 0) ? at(t) : combine(prefix[t - 1], at(t));
+        }
+        for (int t = padded - 1; t >= 0; --t) {
+            bool block_end = (t % window == window - 1) || t == padded - 1;
+            suffix[t] = block_end ? at(t) : combine(at(t), suffix[t + 1]);
+        }
+        for (int i = 0; i < height; ++i) {
+            out[i] = combine(suffix[i], prefix[i + window - 1]);
+        }
+        return out;
+    }
+
+    // Builds row i straight from a per-pixel predicate (row must already be empty)
+    template <typename IsBlack>
+    void buildRow(int i, IsBlack is_black) {
+        Node* head = nullptr;
+        Node* tail = nullptr;
+        int start = -1;
+        for (int j = 0; j < width; ++j) {
+            if (is_black(j)) {
+                if (start == -1) start = j;
+            } else if (start != -1) {
+                Node* new_node = new Node(start, j - 1);
+                if (head == nullptr) head = new_node;
+                if (tail != nullptr) tail->next = new_node;
+                tail = new_node;
+                start = -1;
+            }
+        }
+        if (start != -1) {
+            Node* new_node = new Node(start, width - 1);
+            if (head == nullptr) head = new_node;
+            if (tail != nullptr) tail->next = new_node;
+        }
+        image[i] = head;
+        refreshRowStats(i);
+    }
+
+    // Minimal cursor over the compressed text; whitespace between tokens is ignored
+    struct CompressedParser {
+        const char* pos;
+        const char* end;
+
+        // Returns the next non-space character without consuming it, or '\0' at the end
+        char peek() {
+            while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\t' || *pos == '\r')) ++pos;
+            return pos < end ? *pos : '\0';
+        }
+
+        void expect(char c) {
+            if (peek() != c) {
+                throw CompressedFormatException(string("Expected '") + c + "' in compressed image.");
+            }
+            ++pos;
+        }
+
+        int readInt() {
+            peek();
+            int value = 0;
+            from_chars_result r = from_chars(pos, end, value);
+            if (r.ec != errc()) throw CompressedFormatException("Expected a number in compressed image.");
+            pos = r.ptr;
+            return value;
+        }
+    };
+
+    struct CountingSink {
+        size_t count = 0;
+        void put(const char*, size_t n) { count += n; }
+    };
+
+    struct StringSink {
+        string& out;
+        void put(const char* data, size_t n) { out.append(data, n); }
+    };
+
+    struct BufferSink {
+        char* buffer;
+        size_t capacity;
+        size_t count;
+        void put(const char* data, size_t n) {
+            if (count < capacity) {
+                memcpy(buffer + count, data, min(n, capacity - count));
+            }
+            count += n;
+        }
+    };
+
+    // Buffers output in a fixed block so each run does not become a syscall
+    struct FdSink {
+        int fd;
+        char block[4096];
+        size_t used = 0;
+
+        explicit FdSink(int f) : fd(f) {}
+
+        void put(const char* data, size_t n) {
+            if (used + n > sizeof(block)) flush();
+            memcpy(block + used, data, n); // n is always small (one token)
+            used += n;
+        }
+
+        void flush() {
+            size_t written = 0;
+            while (written < used) {
+                ssize_t r = ::write(fd, block + written, used - written);
+                if (r < 0) throw runtime_error("Failed to write compressed image.");
+                written += static_cast<size_t>(r);
+            }
+            used = 0;
+        }
+    };
+
+    template <typename Sink>
+    static void putInt(Sink& sink, int value) {
+        char digits[16];
+        char* end = to_chars(digits, digits + sizeof(digits), value).ptr;
+        sink.put(digits, end - digits);
+    }
+
+    template <typename Sink>
+    void emitCompressed(Sink& sink) {
+        putInt(sink, width);
+        sink.put(" ", 1);
+        putInt(sink, height);
+        if (height == 0) {
+            sink.put(",", 1); // The trailing space is trimmed like every other final char
+            return;
+        }
+        sink.put(", ", 2);
+        for (int i = 0; i < height; ++i) {
+            Node* current = image[i];
+            if (current == nullptr) {
+                sink.put(" / ", 3); // Represent all-white row
+            } else {
+                while (current != nullptr) {
+                    sink.put("(", 1);
+                    putInt(sink, current->start_index);
+                    sink.put(",", 1);
+                    putInt(sink, current->end_index);
+                    sink.put(") ", 2);
+                    current = current->next;
+                }
+            }
+            // The final row separator is dropped, matching the original format
+            if (i + 1 < height) sink.put(",", 1);
+        }
+    }
+};
+
+// --- Image Pyramid ---
+// Levels are built on first request, each from the previous level at half
+// resolution, and kept for later requests. Level 0 is the source image, which
+// must outlive the pyramid; rebuild the pyramid if the source changes.
+class RunLengthPyramid {
+private:
+    const RunLengthImage* base;
+    RunLengthImage::Reduction mode;
+    vector<unique_ptr<RunLengthImage>> levels; // levels[k - 1] holds level k
+
+public:
+    RunLengthPyramid(const RunLengthImage& source, RunLengthImage::Reduction reduction)
+        : base(&source), mode(reduction) {}
+
+    const RunLengthImage& level(int k) {
+        if (k < 0) throw out_of_range("Pyramid level must be non-negative.");
+        while (static_cast<int>(levels.size()) < k) {
+            const RunLengthImage& previous = levels.empty() ? *base : *levels.back();
+            levels.push_back(previous.downsample(2, mode));
+        }
+        return k == 0 ? *base : *levels[k - 1];
+    }
+
+    // Number of levels until the image is 1 x 1
+    int levelCount() const {
+        int count = 1;
+        for (int w = base->getWidth(), h = base->getHeight(); w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) {
+            ++count;
+        }
+        return count;
+    }
+};
+
+// --- Grayscale Compressed Linked List Structure ---
+// Represents a run of pixels sharing one 8-bit value: [start, end] = value
+struct GrayNode {
+    int start_index;
+    int end_index;
+    unsigned char value;
+    GrayNode* next;
+
+    GrayNode(int start, int end, unsigned char v) : start_index(start), end_index(end), value(v), next(nullptr) {}
+};
+
+// Eight binary layers of an 8-bit image; planes[b] holds bit b as its pixel
+// value (1 = white, 0 = black), so performAnd/performXor on two planes act as
+// bitwise AND/XOR of that bit. With gray_coded set, the bits are those of
+// v ^ (v >> 1), which changes one bit per step between neighbouring values
+// and so keeps runs longer.
+struct BitPlanes {
+    array<unique_ptr<RunLengthImage>, 8> planes;
+    bool gray_coded = false;
+};
+
+// Multi-level image: every row is fully covered by (start, end, value) runs,
+// so flat regions of any shade cost a single node.
+class GrayscaleRunImage : public CompressedImageInterface {
+private:
+    vector<GrayNode*> image; // Vector of head pointers, one for each row
+    int height;
+    int width;
+
+    void cleanup_row(int i) {
+        GrayNode* current = image[i];
+        while (current != nullptr) {
+            GrayNode* next_node = current->next;
+            delete current;
+            current = next_node;
+        }
+        image[i] = nullptr;
+    }
+
+    // Appends a run to a row under construction, merging with an equal-valued tail
+    static void appendRun(GrayNode*& head, GrayNode*& tail, int start, int end, unsigned char value) {
+        if (tail != nullptr && tail->value == value && tail->end_index + 1 == start) {
+            tail->end_index = end;
+            return;
+        }
+        GrayNode* new_node = new GrayNode(start, end, value);
+        if (head == nullptr) head = new_node;
+        if (tail != nullptr) tail->next = new_node;
+        tail = new_node;
+    }
+
+    template <typename ValueAt>
+    void buildRow(int i, ValueAt value_at) {
+        GrayNode* head = nullptr;
+        GrayNode* tail = nullptr;
+        for (int j = 0; j < width; ++j) {
+            unsigned char v = value_at(j);
+            appendRun(head, tail, j, j, v);
+        }
+        image[i] = head;
+    }
+
+    GrayscaleRunImage* checkedOther(CompressedImageInterface* img) {
+        GrayscaleRunImage* other = dynamic_cast<GrayscaleRunImage*>(img);
+        if (other == nullptr || this->width != other->width || this->height != other->height) {
+            throw BoundsMismatchException("Size of the two images do not match!");
+        }
+        return other;
+    }
+
+    // Sweeps two rows' runs together, visiting each maximal segment where
+    // both values are constant: visit(start, end, a_value, b_value)
+    template <typename Visit>
+    static void sweepRows(const GrayNode* a, const GrayNode* b, Visit visit) {
+        int position = 0;
+        while (a != nullptr && b != nullptr) {
+            int end = min(a->end_index, b->end_index);
+            visit(position, end, a->value, b->value);
+            position = end + 1;
+            if (a->end_index == end) a = a->next;
+            if (b->end_index == end) b = b->next;
+        }
+    }
+
+public:
+    // Builds from a dense grid of 0-255 values
+    GrayscaleRunImage(const vector<vector<int>>& grid, int w, int h) : height(h), width(w) {
+        image.assign(h, nullptr);
+        for (int i = 0; i < h; ++i) {
+            buildRow(i, [&](int j) { return static_cast<unsigned char>(grid[i][j]); });
+        }
+    }
+
+    // Creates a w x h image filled with a single value
+    GrayscaleRunImage(int w, int h, unsigned char fill) : height(h), width(w) {
+        if (w < 0 || h < 0) throw out_of_range("Image dimensions must be non-negative.");
+        image.assign(h, nullptr);
+        for (int i = 0; i < h && w > 0; ++i) {
+            image[i] = new GrayNode(0, w - 1, fill);
+        }
+    }
+
+    GrayscaleRunImage(const GrayscaleRunImage&) = delete;
+    GrayscaleRunImage& operator=(const GrayscaleRunImage&) = delete;
+
+    ~GrayscaleRunImage() override {
+        for (int i = 0; i < height; ++i) {
+            cleanup_row(i);
+        }
+    }
+
+    // Reads an 8-bit PGM (P2 or P5) one row at a time
+    static unique_ptr<GrayscaleRunImage> fromPGM(istream& in) {
+        PGMReader reader(in);
+        unique_ptr<GrayscaleRunImage> result = make_unique<GrayscaleRunImage>(reader.width, reader.height, 0);
+        vector<unsigned char> row(reader.width);
+        for (int i = 0; i < reader.height; ++i) {
+            reader.readRow(row.data());
+            result->cleanup_row(i);
+            result->buildRow(i, [&](int j) { return row[j]; });
+        }
+        return result;
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    const GrayNode* rowHead(int i) const {
+        if (i < 0 || i >= height) throw out_of_range("Row index out of range.");
+        return image[i];
+    }
+
+    // --- Bit-Plane Decomposition ---
+
+    // Splits the image into eight RunLengthImage planes, one pass over the value runs
+    BitPlanes toBitPlanes(bool gray_code) const {
+        BitPlanes result;
+        result.gray_coded = gray_code;
+        for (int b = 0; b < 8; ++b) {
+            result.planes[b] = make_unique<RunLengthImage>(width, height);
+        }
+        array<vector<pair<int, int>>, 8> runs;
+        for (int i = 0; i < height; ++i) {
+            for (int b = 0; b < 8; ++b) runs[b].clear();
+            for (const GrayNode* current = image[i]; current != nullptr; current = current->next) {
+                int v = gray_code ? (current->value ^ (current->value >> 1)) : current->value;
+                for (int b = 0; b < 8; ++b) {
+                    if (v & (1 << b)) continue; // Clear bits are the black runs
+                    vector<pair<int, int>>& plane_runs = runs[b];
+                    if (!plane_runs.empty() && plane_runs.back().second + 1 == current->start_index) {
+                        plane_runs.back().second = current->end_index;
+                    } else {
+                        plane_runs.emplace_back(current->start_index, current->end_index);
+                    }
+                }
+            }
+            for (int b = 0; b < 8; ++b) result.planes[b]->setRowRuns(i, runs[b]);
+        }
+        return result;
+    }
+
+    // Rebuilds the grayscale image by sweeping all eight planes' runs together per row
+    static unique_ptr<GrayscaleRunImage> fromBitPlanes(const BitPlanes& bit_planes) {
+        for (int b = 0; b < 8; ++b) {
+            if (!bit_planes.planes[b]) throw invalid_argument("Missing bit plane.");
+        }
+        int w = bit_planes.planes[0]->getWidth();
+        int h = bit_planes.planes[0]->getHeight();
+        for (int b = 1; b < 8; ++b) {
+            if (bit_planes.planes[b]->getWidth() != w || bit_planes.planes[b]->getHeight() != h) {
+                throw BoundsMismatchException("Size of the bit planes do not match!");
+            }
+        }
+        unique_ptr<GrayscaleRunImage> result = make_unique<GrayscaleRunImage>(w, h, 0);
+        for (int i = 0; i < h; ++i) {
+            array<const Node*, 8> cursor;
+            for (int b = 0; b < 8; ++b) cursor[b] = bit_planes.planes[b]->rowHead(i);
+            GrayNode* head = nullptr;
+            GrayNode* tail = nullptr;
+            int position = 0;
+            while (position < w) {
+                int v = 0;
+                int segment_end = w - 1;
+                for (int b = 0; b < 8; ++b) {
+                    const Node*& run = cursor[b];
+                    while (run != nullptr && run->end_index < position) run = run->next;
+                    if (run != nullptr && run->start_index <= position) {
+                        v |= 1 << b;
+                        segment_end = min(segment_end, run->end_index);
+                    } else if (run != nullptr) {
+                        segment_end = min(segment_end, run->start_index - 1);
+                    }
+                }
+                v ^= 0xFF; // Black runs mark clear bits
+                if (bit_planes.gray_coded) {
+                    v ^= v >> 1;
+                    v ^= v >> 2;
+                    v ^= v >> 4;
+                }
+                appendRun(head, tail, position, segment_end, static_cast<unsigned char>(v));
+                position = segment_end + 1;
+            }
+            result->cleanup_row(i);
+            result->image[i] = head;
+        }
+        return result;
+    }
+
+    // Combines two images pixel-wise over runs; op maps (a, b) to the new value
+    void performOperation(CompressedImageInterface* img, function<unsigned char(unsigned char, unsigned char)> op) {
+        GrayscaleRunImage* other = checkedOther(img);
+        for (int i = 0; i < height; ++i) {
+            GrayNode* head = nullptr;
+            GrayNode* tail = nullptr;
+            sweepRows(image[i], other->image[i], [&](int start, int end, unsigned char a, unsigned char b) {
+                appendRun(head, tail, start, end, op(a, b));
+            });
+            cleanup_row(i);
+            image[i] = head;
+        }
+    }
+
+    void performAnd(CompressedImageInterface* img) override {
+        performOperation(img, [](unsigned char a, unsigned char b) { return static_cast<unsigned char>(a & b); });
+    }
+
+    void performXor(CompressedImageInterface* img) override {
+        performOperation(img, [](unsigned char a, unsigned char b) { return static_cast<unsigned char>(a ^ b); });
+    }
+
+    void performMin(CompressedImageInterface* img) {
+        performOperation(img, [](unsigned char a, unsigned char b) { return min(a, b); });
+    }
+
+    void performMax(CompressedImageInterface* img) {
+        performOperation(img, [](unsigned char a, unsigned char b) { return max(a, b); });
+    }
+
+    // Inverts every value (v -> 255 - v); run boundaries are unchanged
+    void invert() override {
+        for (int i = 0; i < height; ++i) {
+            for (GrayNode* current = image[i]; current != nullptr; current = current->next) {
+                current->value = static_cast<unsigned char>(255 - current->value);
+            }
+        }
+    }
+
+    // Smallest pixel value in the image (255 for an empty image)
+    int minValue() const {
+        int result = 255;
+        for (int i = 0; i < height; ++i) {
+            for (const GrayNode* current = image[i]; current != nullptr; current = current->next) {
+                result = min(result, static_cast<int>(current->value));
+            }
+        }
+        return result;
+    }
+
+    // Largest pixel value in the image (0 for an empty image)
+    int maxValue() const {
+        int result = 0;
+        for (int i = 0; i < height; ++i) {
+            for (const GrayNode* current = image[i]; current != nullptr; current = current->next) {
+                result = max(result, static_cast<int>(current->value));
+            }
+        }
+        return result;
+    }
+
+    // Binary mask where pixels at or below the threshold are black
+    unique_ptr<RunLengthImage> threshold(int t) const {
+        unique_ptr<RunLengthImage> mask = make_unique<RunLengthImage>(width, height);
+        vector<pair<int, int>> runs;
+        for (int i = 0; i < height; ++i) {
+            runs.clear();
+            for (const GrayNode* current = image[i]; current != nullptr; current = current->next) {
+                if (current->value > t) continue;
+                if (!runs.empty() && runs.back().second + 1 == current->start_index) {
+                    runs.back().second = current->end_index;
+                } else {
+                    runs.emplace_back(current->start_index, current->end_index);
+                }
+            }
+            mask->setRowRuns(i, runs);
+        }
+        return mask;
+    }
+
+    // Binary mask where pred(this_value, other_value) holds, e.g. less<int>() or not_equal_to<int>()
+    unique_ptr<RunLengthImage> compare(CompressedImageInterface* img, function<bool(int, int)> pred) {
+        GrayscaleRunImage* other = checkedOther(img);
+        unique_ptr<RunLengthImage> mask = make_unique<RunLengthImage>(width, height);
+        vector<pair<int, int>> runs;
+        for (int i = 0; i < height; ++i) {
+            runs.clear();
+            sweepRows(image[i], other->image[i], [&](int start, int end, unsigned char a, unsigned char b) {
+                if (!pred(a, b)) return;
+                if (!runs.empty() && runs.back().second + 1 == start) runs.back().second = end;
+                else runs.emplace_back(start, end);
+            });
+            mask->setRowRuns(i, runs);
+        }
+        return mask;
+    }
+
+    // Same layout as the binary format, with each run written as (s,e:v)
+    string toStringCompressed() override {
+        string result = to_string(width) + " " + to_string(height) + ", ";
+        for (int i = 0; i < height; ++i) {
+            GrayNode* current = image[i];
+            if (current == nullptr) {
+                result += " / ";
+            }
+            while (current != nullptr) {
+                result += "(" + to_string(current->start_index) + "," + to_string(current->end_index) +
+                          ":" + to_string(current->value) + ") ";
+                current = current->next;
+            }
+            result += ",";
+        }
+        result.pop_back();
+        return result;
+    }
+};
+
+// --- Run-Based Analysis ---
+
+// Disjoint-set forest over run indices (path halving, union by size)
+class UnionFind {
+private:
+    vector<int> parent;
+    vector<int> size;
+
+public:
+    explicit UnionFind(int n) : parent(n), size(n, 1) {
+        for (int k = 0; k < n; ++k) parent[k] = k;
+    }
+
+    int find(int k) {
+        while (parent[k] != k) {
+            parent[k] = parent[parent[k]];
+            k = parent[k];
+        }
+        return k;
+    }
+
+    void unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return;
+        if (size[a] < size[b]) swap(a, b);
+        parent[b] = a;
+        size[a] += size[b];
+    }
+};
+
+struct ComponentStats {
+    long long area = 0;
+    int min_x = 0, min_y = 0, max_x = 0, max_y = 0; // Inclusive bounding box
+    double centroid_x = 0;
+    double centroid_y = 0;
+};
+
+// Components are numbered 0..n-1 in raster order of their first run.
+// run_labels[i][k] is the component of the k-th run in row i.
+struct ComponentLabeling {
+    vector<ComponentStats> components;
+    vector<vector<int>> run_labels;
+};
+
+// Labels the black regions of img with 4- or 8-connectivity. Runs in adjacent
+// rows are merged when they overlap (or touch diagonally, for 8-connectivity),
+// so the cost is proportional to the number of runs, not pixels.
+ComponentLabeling labelComponents(const RunLengthImage& img, int connectivity) {
+    if (connectivity != 4 && connectivity != 8) throw invalid_argument("Connectivity must be 4 or 8.");
+    int h = img.getHeight();
+    int reach = (connectivity == 8) ? 1 : 0;
+
+    // Flatten runs so each gets a global index for the union-find
+    vector<const Node*> runs;
+    vector<int> row_first(h + 1, 0);
+    for (int i = 0; i < h; ++i) {
+        row_first[i] = static_cast<int>(runs.size());
+        for (const Node* current = img.rowHead(i); current != nullptr; current = current->next) {
+            runs.push_back(current);
+        }
+    }
+    row_first[h] = static_cast<int>(runs.size());
+
+    UnionFind sets(static_cast<int>(runs.size()));
+    for (int i = 1; i < h; ++i) {
+        int p = row_first[i - 1];
+        int q = row_first[i];
+        while (p < row_first[i] && q < row_first[i + 1]) {
+            const Node* above = runs[p];
+            const Node* below = runs[q];
+            if (above->start_index <= below->end_index + reach && below->start_index <= above->end_index + reach) {
+                sets.unite(p, q);
+            }
+            if (above->end_index < below->end_index) ++p;
+            else ++q;
+        }
+    }
+
+    ComponentLabeling result;
+    result.run_labels.resize(h);
+    vector<int> label_of_root(runs.size(), -1);
+    vector<double> sum_x;
+    vector<double> sum_y;
+    for (int i = 0; i < h; ++i) {
+        for (int k = row_first[i]; k < row_first[i + 1]; ++k) {
+            int root = sets.find(k);
+            if (label_of_root[root] == -1) {
+                label_of_root[root] = static_cast<int>(result.components.size());
+                ComponentStats fresh;
+                fresh.min_x = runs[k]->start_index;
+                fresh.max_x = runs[k]->end_index;
+                fresh.min_y = fresh.max_y = i;
+                result.components.push_back(fresh);
+                sum_x.push_back(0);
+                sum_y.push_back(0);
+            }
+            int label = label_of_root[root];
+            result.run_labels[i].push_back(label);
+
+            ComponentStats& stats = result.components[label];
+            long long length = runs[k]->end_index - runs[k]->start_index + 1;
+            stats.area += length;
+            stats.min_x = min(stats.min_x, runs[k]->start_index);
+            stats.max_x = max(stats.max_x, runs[k]->end_index);
+            stats.max_y = i;
+            sum_x[label] += static_cast<double>(runs[k]->start_index + runs[k]->end_index) * length / 2.0;
+            sum_y[label] += static_cast<double>(i) * length;
+        }
+    }
+    for (size_t c = 0; c < result.components.size(); ++c) {
+        result.components[c].centroid_x = sum_x[c] / result.components[c].area;
+        result.components[c].centroid_y = sum_y[c] / result.components[c].area;
+    }
+    return result;
+}
+
+// --- Mask Similarity ---
+// Read-only comparisons: both run lists are swept in parallel and the
+// per-image black totals come from the statistics cache, so nothing is
+// allocated or modified. `predicted` and `truth` name the two operands for
+// precision/recall; the other metrics are symmetric.
+
+struct OverlapCounts {
+    long long both = 0;       // Black in both images
+    long long only_first = 0; // Black only in the first image
+    long long only_second = 0;
+};
+
+OverlapCounts overlapCounts(const RunLengthImage& first, const RunLengthImage& second) {
+    if (first.getWidth() != second.getWidth() || first.getHeight() != second.getHeight()) {
+        throw BoundsMismatchException("Size of the two images do not match!");
+    }
+    OverlapCounts counts;
+    for (int i = 0; i < first.getHeight(); ++i) {
+        const Node* a = first.rowHead(i);
+        const Node* b = second.rowHead(i);
+        while (a != nullptr && b != nullptr) {
+            int start = max(a->start_index, b->start_index);
+            int end = min(a->end_index, b->end_index);
+            if (start <= end) counts.both += end - start + 1;
+            if (a->end_index < b->end_index) a = a->next;
+            else b = b->next;
+        }
+    }
+    counts.only_first = first.blackPixelCount() - counts.both;
+    counts.only_second = second.blackPixelCount() - counts.both;
+    return counts;
+}
+
+// Shared rule for empty denominators: two empty masks agree perfectly,
+// anything else scores zero.
+inline double overlapRatio(long long numerator, long long denominator, const OverlapCounts& counts) {
+    if (denominator == 0) return (counts.only_first == 0 && counts.only_second == 0) ? 1.0 : 0.0;
+    return static_cast<double>(numerator) / denominator;
+}
+
+// Number of pixels that differ (popcount of the XOR)
+long long hammingDistance(const RunLengthImage& first, const RunLengthImage& second) {
+    OverlapCounts counts = overlapCounts(first, second);
+    return counts.only_first + counts.only_second;
+}
+
+// Hamming distance between first and second translated by (dx, dy); pixels
+// shifted in from outside are white. Neither image is modified or copied.
+long long shiftedHammingDistance(const RunLengthImage& first, const RunLengthImage& second, int dx, int dy) {
+    if (first.getWidth() != second.getWidth() || first.getHeight() != second.getHeight()) {
+        throw BoundsMismatchException("Size of the two images do not match!");
+    }
+    long long shifted_black = 0;
+    long long both = 0;
+    for (int i = 0; i < first.getHeight(); ++i) {
+        const Node* a = first.rowHead(i);
+        first.forEachShiftedRun(second, dx, dy, i, [&](int start, int end) {
+            shifted_black += end - start + 1;
+            while (a != nullptr && a->end_index < start) a = a->next;
+            for (const Node* current = a; current != nullptr && current->start_index <= end; current = current->next) {
+                both += min(end, current->end_index) - max(start, current->start_index) + 1;
+            }
+        });
+    }
+    return first.blackPixelCount() + shifted_black - 2 * both;
+}
+
+double jaccardIndex(const RunLengthImage& first, const RunLengthImage& second) {
+    OverlapCounts c = overlapCounts(first, second);
+    return overlapRatio(c.both, c.both + c.only_first + c.only_second, c);
+}
+
+double diceCoefficient(const RunLengthImage& first, const RunLengthImage& second) {
+    OverlapCounts c = overlapCounts(first, second);
+    return overlapRatio(2 * c.both, 2 * c.both + c.only_first + c.only_second, c);
+}
+
+double precision(const RunLengthImage& predicted, const RunLengthImage& truth) {
+    OverlapCounts c = overlapCounts(predicted, truth);
+    return overlapRatio(c.both, c.both + c.only_first, c);
+}
+
+double recall(const RunLengthImage& predicted, const RunLengthImage& truth) {
+    OverlapCounts c = overlapCounts(predicted, truth);
+    return overlapRatio(c.both, c.both + c.only_second, c);
+}
+
+// --- Image Moments ---
+// Raw moments are exact integer sums over runs. For a run [s, e] in row y:
+//   sum x   = (s + e) * n / 2                    (n = e - s + 1)
+//   sum x^2 = S2(e) - S2(s - 1),  S2(k) = k (k + 1) (2k + 1) / 6
+// They are accumulated in 128-bit integers so large images cannot overflow.
+
+struct ShapeMoments {
+    long long area = 0;
+    double centroid_x = 0, centroid_y = 0;
+    double mu20 = 0, mu02 = 0, mu11 = 0; // Second-order central moments
+    double orientation = 0;  // Major axis angle in radians, y pointing down
+    double eccentricity = 0; // 0 for a circle, approaching 1 for a line
+};
+
+struct RawMoments {
+    __int128 m00 = 0, m10 = 0, m01 = 0, m20 = 0, m02 = 0, m11 = 0;
+
+    void addRun(int y, int start, int end) {
+        __int128 n = end - start + 1;
+        __int128 sum_x = (static_cast<__int128>(start) + end) * n / 2;
+        auto sum_squares = [](__int128 k) { return k * (k + 1) * (2 * k + 1) / 6; };
+        m00 += n;
+        m10 += sum_x;
+        m01 += n * y;
+        m20 += sum_squares(end) - sum_squares(static_cast<__int128>(start) - 1);
+        m02 += n * y * y;
+        m11 += sum_x * y;
+    }
+
+    ShapeMoments finish() const {
+        ShapeMoments result;
+        result.area = static_cast<long long>(m00);
+        if (m00 == 0) return result;
+        double area = static_cast<double>(m00);
+        result.centroid_x = static_cast<double>(m10) / area;
+        result.centroid_y = static_cast<double>(m01) / area;
+        // Central moments from exact raw sums: mu_pq = m_pq - m_p0 * m_0q / m00
+        result.mu20 = static_cast<double>(m20 * m00 - m10 * m10) / area;
+        result.mu02 = static_cast<double>(m02 * m00 - m01 * m01) / area;
+        result.mu11 = static_cast<double>(m11 * m00 - m10 * m01) / area;
+        result.orientation = 0.5 * atan2(2 * result.mu11, result.mu20 - result.mu02);
+        double spread = sqrt(4 * result.mu11 * result.mu11 + (result.mu20 - result.mu02) * (result.mu20 - result.mu02));
+        double major = (result.mu20 + result.mu02 + spread) / 2;
+        double minor = (result.mu20 + result.mu02 - spread) / 2;
+        result.eccentricity = major > 0 ? sqrt(max(0.0, 1 - minor / major)) : 0;
+        return result;
+    }
+};
+
+// Moments of all black pixels, O(runs)
+ShapeMoments computeMoments(const RunLengthImage& img) {
+    RawMoments raw;
+    for (int i = 0; i < img.getHeight(); ++i) {
+        for (const Node* current = img.rowHead(i); current != nullptr; current = current->next) {
+            raw.addRun(i, current->start_index, current->end_index);
+        }
+    }
+    return raw.finish();
+}
+
+// Moments of each component of a labeling produced by labelComponents on img
+vector<ShapeMoments> computeComponentMoments(const RunLengthImage& img, const ComponentLabeling& labeling) {
+    vector<RawMoments> raw(labeling.components.size());
+    for (int i = 0; i < img.getHeight(); ++i) {
+        int k = 0;
+        for (const Node* current = img.rowHead(i); current != nullptr; current = current->next, ++k) {
+            raw[labeling.run_labels[i][k]].addRun(i, current->start_index, current->end_index);
+        }
+    }
+    vector<ShapeMoments> result;
+    result.reserve(raw.size());
+    for (const RawMoments& component : raw) result.push_back(component.finish());
+    return result;
+}
+
+// --- Projection Profiles ---
+
+// Black pixels per row, read from the statistics cache
+vector<int> rowProfile(const RunLengthImage& img) {
+    vector<int> profile(img.getHeight());
+    for (int i = 0; i < img.getHeight(); ++i) {
+        profile[i] = img.rowBlackCount(i);
+    }
+    return profile;
+}
+
+// Black pixels per column: +1 at each run start and -1 past each run end,
+// then one prefix sum, so the cost is O(runs + width)
+vector<int> columnProfile(const RunLengthImage& img) {
+    vector<int> profile(img.getWidth() + 1, 0);
+    for (int i = 0; i < img.getHeight(); ++i) {
+        for (const Node* current = img.rowHead(i); current != nullptr; current = current->next) {
+            profile[current->start_index]++;
+            profile[current->end_index + 1]--;
+        }
+    }
+    for (int j = 1; j < img.getWidth(); ++j) {
+        profile[j] += profile[j - 1];
+    }
+    profile.pop_back();
+    return profile;
+}
+
+struct BoundingBox {
+    bool empty = true;
+    int min_x = 0, min_y = 0, max_x = 0, max_y = 0; // Inclusive
+};
+
+// Tight box around all black pixels; only the first and last run of each row matter
+BoundingBox boundingBox(const RunLengthImage& img) {
+    BoundingBox box;
+    for (int i = 0; i < img.getHeight(); ++i) {
+        const Node* current = img.rowHead(i);
+        if (current == nullptr) continue;
+        int first = current->start_index;
+        while (current->next != nullptr) current = current->next;
+        if (box.empty) {
+            box = {false, first, i, current->end_index, i};
+        } else {
+            box.min_x = min(box.min_x, first);
+            box.max_x = max(box.max_x, current->end_index);
+            box.max_y = i;
+        }
+    }
+    return box;
+}
+
+// --- Distance Transform ---
+
+// Felzenszwalb-Huttenlocher 1D squared-distance transform of f (length n) into d
+inline void distanceTransform1D(const double* f, double* d, int n, vector<int>& v, vector<double>& z) {
+    v.resize(n);
+    z.resize(n + 1);
+    int k = 0;
+    v[0] = 0;
+    z[0] = -HUGE_VAL;
+    z[1] = HUGE_VAL;
+    for (int q = 1; q < n; ++q) {
+        // Intersection of parabola q with the rightmost kept parabola; z[0] is
+        // -infinity, so k never drops below 0
+        double s = ((f[q] + static_cast<double>(q) * q) - (f[v[k]] + static_cast<double>(v[k]) * v[k])) / (2.0 * (q - v[k]));
+        while (s <= z[k]) {
+            --k;
+            s = ((f[q] + static_cast<double>(q) * q) - (f[v[k]] + static_cast<double>(v[k]) * v[k])) / (2.0 * (q - v[k]));
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = HUGE_VAL;
+    }
+    k = 0;
+    for (int q = 0; q < n; ++q) {
+        while (z[k + 1] < q) ++k;
+        double offset = q - v[k];
+        d[q] = offset * offset + f[v[k]];
+    }
+}
+
+// Exact Euclidean distance from every pixel to the nearest black pixel, as
+// result[y][x]; black pixels are 0 and an image with no black gives infinity.
+// The horizontal pass is read straight off each row's run endpoints (blank rows
+// are a single fill), then the 1D transform runs down each column.
+vector<vector<double>> distanceTransform(const RunLengthImage& img) {
+    const double far = 1e20; // Finite stand-in for infinity inside the 1D transform
+    int w = img.getWidth();
+    int h = img.getHeight();
+    vector<double> squared(static_cast<size_t>(w) * h, far);
+
+    for (int i = 0; i < h; ++i) {
+        double* row = squared.data() + static_cast<size_t>(i) * w;
+        const Node* current = img.rowHead(i);
+        if (current == nullptr) continue;
+        int previous_end = -1; // End of the run to the left, -1 if none
+        while (true) {
+            int next_start = current != nullptr ? current->start_index : w;
+            for (int x = previous_end + 1; x < next_start; ++x) {
+                double left = previous_end >= 0 ? x - previous_end : far;
+                double right = current != nullptr ? next_start - x : far;
+                double nearest = min(left, right);
+                row[x] = nearest * nearest;
+            }
+            if (current == nullptr) break;
+            for (int x = current->start_index; x <= current->end_index; ++x) row[x] = 0;
+            previous_end = current->end_index;
+            current = current->next;
+        }
+    }
+
+    vector<vector<double>> result(h, vector<double>(w));
+    if (img.isEmpty()) {
+        for (vector<double>& row : result) fill(row.begin(), row.end(), HUGE_VAL);
+        return result;
+    }
+    vector<double> column(h), transformed(h);
+    vector<int> v;
+    vector<double> z;
+    for (int x = 0; x < w; ++x) {
+        for (int i = 0; i < h; ++i) column[i] = squared[static_cast<size_t>(i) * w + x];
+        distanceTransform1D(column.data(), transformed.data(), h, v, z);
+        for (int i = 0; i < h; ++i) result[i][x] = sqrt(transformed[i]);
+    }
+    return result;
+}
+
+// --- Contour Extraction ---
+
+// A closed boundary along pixel edges; points are lattice corners (x, y) in
+// [0, width] x [0, height]. The polygon closes from the last point back to the
+// first. Black lies on the right when walking the points in order, so outer
+// boundaries run clockwise on screen and holes counter-clockwise.
+struct Contour {
+    vector<pair<int, int>> points;
+    bool is_hole = false;
+};
+
+// Traces every outer and hole boundary. Boundary edges come from run endpoints
+// (vertical edges) and from the differences between adjacent rows (horizontal
+// edges), so the work is proportional to the number of runs. Diagonally touching
+// black pixels share one contour, matching 8-connected components.
+vector<Contour> traceContours(const RunLengthImage& img) {
+    struct Edge {
+        int x0, y0, x1, y1;
+        bool used = false;
+    };
+    int w = img.getWidth();
+    int h = img.getHeight();
+    vector<Edge> edges;
+    RunList previous;
+    for (int y = 0; y <= h; ++y) {
+        RunList current = (y < h) ? img.getRowRuns(y) : RunList();
+        // Black below the lattice line runs east, black above runs west
+        for (const pair<int, int>& run : intersectRuns(current, complementRuns(previous, w))) {
+            edges.push_back({run.first, y, run.second + 1, y});
+        }
+        for (const pair<int, int>& run : intersectRuns(previous, complementRuns(current, w))) {
+            edges.push_back({run.second + 1, y, run.first, y});
+        }
+        // Left sides run north, right sides run south
+        for (const pair<int, int>& run : current) {
+            edges.push_back({run.first, y + 1, run.first, y});
+            edges.push_back({run.second + 1, y, run.second + 1, y + 1});
+        }
+        previous.swap(current);
+    }
+
+    // Each lattice corner has one outgoing edge, or two at a diagonal saddle
+    unordered_map<long long, array<int, 2>> outgoing;
+    outgoing.reserve(edges.size());
+    auto key = [&](int x, int y) { return static_cast<long long>(y) * (w + 1) + x; };
+    for (int e = 0; e < static_cast<int>(edges.size()); ++e) {
+        auto inserted = outgoing.emplace(key(edges[e].x0, edges[e].y0), array<int, 2>{e, -1});
+        if (!inserted.second) inserted.first->second[1] = e;
+    }
+
+    vector<Contour> contours;
+    for (int first = 0; first < static_cast<int>(edges.size()); ++first) {
+        if (edges[first].used) continue;
+        Contour contour;
+        long long twice_area = 0;
+        int e = first;
+        while (!edges[e].used) {
+            Edge& edge = edges[e];
+            edge.used = true;
+            twice_area += static_cast<long long>(edge.x0) * edge.y1 - static_cast<long long>(edge.x1) * edge.y0;
+            int dx = (edge.x1 > edge.x0) - (edge.x1 < edge.x0);
+            int dy = (edge.y1 > edge.y0) - (edge.y1 < edge.y0);
+
+            const array<int, 2>& options = outgoing[key(edge.x1, edge.y1)];
+            int next = options[0];
+            if (options[1] != -1) {
+                // Saddle: take the left turn (screen coordinates), joining the diagonal pixels
+                const Edge& candidate = edges[options[0]];
+                int cdx = (candidate.x1 > candidate.x0) - (candidate.x1 < candidate.x0);
+                int cdy = (candidate.y1 > candidate.y0) - (candidate.y1 < candidate.y0);
+                bool is_left_turn = (cdx == dy && cdy == -dx);
+                next = is_left_turn ? options[0] : options[1];
+            }
+            const Edge& following = edges[next];
+            int ndx = (following.x1 > following.x0) - (following.x1 < following.x0);
+            int ndy = (following.y1 > following.y0) - (following.y1 < following.y0);
+            if (ndx != dx || ndy != dy) contour.points.emplace_back(edge.x1, edge.y1); // Keep corners only
+            e = next;
+        }
+        contour.is_hole = twice_area < 0;
+        contours.push_back(move(contour));
+    }
+    return contours;
+}
+
+// Douglas-Peucker simplification of a closed polygon: points farther than
+// epsilon from the simplified outline are kept. The polygon is split at its
+// first point and the point farthest from it, and each half is simplified.
+vector<pair<int, int>> simplifyPolygon(const vector<pair<int, int>>& points, double epsilon) {
+    int n = static_cast<int>(points.size());
+    if (n <= 3) return points;
+
+    vector<bool> keep(n, false);
+    // Distance from p to the segment a-b
+    auto distance = [](const pair<int, int>& p, const pair<int, int>& a, const pair<int, int>& b) {
+        double vx = b.first - a.first, vy = b.second - a.second;
+        double wx = p.first - a.first, wy = p.second - a.second;
+        double length_squared = vx * vx + vy * vy;
+        double t = length_squared > 0 ? max(0.0, min(1.0, (wx * vx + wy * vy) / length_squared)) : 0.0;
+        double ex = wx - t * vx, ey = wy - t * vy;
+        return sqrt(ex * ex + ey * ey);
+    };
+    // Explicit-stack Douglas-Peucker over index range [from, to]; index n wraps to 0
+    auto simplify = [&](int from, int to) {
+        vector<pair<int, int>> pending{{from, to}};
+        while (!pending.empty()) {
+            pair<int, int> range = pending.back();
+            pending.pop_back();
+            const pair<int, int>& a = points[range.first % n];
+            const pair<int, int>& b = points[range.second % n];
+            double worst = -1;
+            int worst_index = -1;
+            for (int k = range.first + 1; k < range.second; ++k) {
+                double d = distance(points[k % n], a, b);
+                if (d > worst) {
+                    worst = d;
+                    worst_index = k;
+                }
+            }
+            if (worst_index != -1 && worst > epsilon) {
+                keep[worst_index % n] = true;
+                pending.emplace_back(range.first, worst_index);
+                pending.emplace_back(worst_index, range.second);
+            }
+        }
+    };
+
+    int farthest = 1;
+    double farthest_distance = -1;
+    for (int k = 1; k < n; ++k) {
+        double dx = points[k].first - points[0].first, dy = points[k].second - points[0].second;
+        if (dx * dx + dy * dy > farthest_distance) {
+            farthest_distance = dx * dx + dy * dy;
+            farthest = k;
+        }
+    }
+    keep[0] = keep[farthest] = true;
+    simplify(0, farthest);
+    simplify(farthest, n);
+
+    vector<pair<int, int>> result;
+    for (int k = 0; k < n; ++k) {
+        if (keep[k]) result.push_back(points[k]);
+    }
+    return result;
+}
+
+// --- Thinning ---
+
+// Zhang-Suen thinning to one-pixel-wide strokes. Rows without runs are white and
+// thinning never adds pixels, so every band of consecutive non-blank rows is
+// independent: each band is expanded into a small buffer covering only its own
+// column extent, thinned there, and encoded back. Blank bands cost nothing.
+unique_ptr<RunLengthImage> skeletonize(const RunLengthImage& img) {
+    int w = img.getWidth();
+    int h = img.getHeight();
+    unique_ptr<RunLengthImage> result = make_unique<RunLengthImage>(w, h);
+
+    int band_top = 0;
+    while (band_top < h) {
+        if (img.rowHead(band_top) == nullptr) {
+            ++band_top;
+            continue;
+        }
+        int band_bottom = band_top;
+        int min_x = w, max_x = -1;
+        while (band_bottom < h && img.rowHead(band_bottom) != nullptr) {
+            RunList runs = img.getRowRuns(band_bottom);
+            min_x = min(min_x, runs.front().first);
+            max_x = max(max_x, runs.back().second);
+            ++band_bottom;
+        }
+
+        // Buffer with a one-pixel white border; 1 marks a black (foreground) pixel
+        int bw = max_x - min_x + 3;
+        int bh = band_bottom - band_top + 2;
+        vector<unsigned char> buffer(static_cast<size_t>(bw) * bh, 0);
+        auto at = [&](int r, int c) -> unsigned char& { return buffer[static_cast<size_t>(r) * bw + c]; };
+        for (int i = band_top; i < band_bottom; ++i) {
+            for (const Node* current = img.rowHead(i); current != nullptr; current = current->next) {
+                for (int x = current->start_index; x <= current->end_index; ++x) at(i - band_top + 1, x - min_x + 1) = 1;
+            }
+        }
+
+        vector<size_t> marked;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int step = 0; step < 2; ++step) {
+                marked.clear();
+                for (int r = 1; r < bh - 1; ++r) {
+                    for (int c = 1; c < bw - 1; ++c) {
+                        if (!at(r, c)) continue;
+                        // Neighbours P2..P9, clockwise from north
+                        int p[8] = {at(r - 1, c), at(r - 1, c + 1), at(r, c + 1), at(r + 1, c + 1),
+                                    at(r + 1, c), at(r + 1, c - 1), at(r, c - 1), at(r - 1, c - 1)};
+                        int neighbours = 0, transitions = 0;
+                        for (int k = 0; k < 8; ++k) {
+                            neighbours += p[k];
+                            if (!p[k] && p[(k + 1) % 8]) ++transitions;
+                        }
+                        if (neighbours < 2 || neighbours > 6 || transitions != 1) continue;
+                        if (step == 0 && ((p[0] && p[2] && p[4]) || (p[2] && p[4] && p[6]))) continue;
+                        if (step == 1 && ((p[0] && p[2] && p[6]) || (p[0] && p[4] && p[6]))) continue;
+                        marked.push_back(static_cast<size_t>(r) * bw + c);
+                    }
+                }
+                for (size_t index : marked) buffer[index] = 0;
+                if (!marked.empty()) changed = true;
+            }
+        }
+
+        RunList runs;
+        for (int r = 1; r < bh - 1; ++r) {
+            runs.clear();
+            for (int c = 1; c < bw - 1; ++c) {
+                if (at(r, c)) appendMerged(runs, c - 1 + min_x, c - 1 + min_x);
+            }
+            result->setRowRuns(band_top + r - 1, runs);
+        }
+        band_top = band_bottom;
+    }
+    return result;
+}
+
+// --- Template Matching ---
+
+struct TemplateMatch {
+    int x, y;         // Top-left corner of the template in the image
+    long long score;
+};
+
+enum class MatchScore {
+    Mismatch, // Pixels that differ (XOR count); keep offsets with score <= threshold
+    Overlap   // Black pixels shared (AND count); keep offsets with score >= threshold
+};
+
+// Slides tmpl over every offset where it fits inside img. Each score is built
+// row by row from run overlaps between the template runs and the image runs in
+// the window, and an offset is abandoned as soon as it can no longer meet the
+// threshold. Neither image is modified.
+vector<TemplateMatch> matchTemplate(const RunLengthImage& img, const RunLengthImage& tmpl, MatchScore mode,
+                                    long long threshold) {
+    int tw = tmpl.getWidth(), th = tmpl.getHeight();
+    if (tw > img.getWidth() || th > img.getHeight()) {
+        throw BoundsMismatchException("Template is larger than the image!");
+    }
+    vector<RunList> image_rows(img.getHeight());
+    for (int i = 0; i < img.getHeight(); ++i) image_rows[i] = img.getRowRuns(i);
+    vector<RunList> template_rows(th);
+    vector<long long> template_remaining(th + 1, 0); // Template black in rows r..th-1
+    for (int r = 0; r < th; ++r) template_rows[r] = tmpl.getRowRuns(r);
+    for (int r = th - 1; r >= 0; --r) template_remaining[r] = template_remaining[r + 1] + tmpl.rowBlackCount(r);
+
+    vector<TemplateMatch> matches;
+    for (int oy = 0; oy + th <= img.getHeight(); ++oy) {
+        for (int ox = 0; ox + tw <= img.getWidth(); ++ox) {
+            int window_end = ox + tw - 1;
+            long long score = 0;
+            bool rejected = false;
+            for (int r = 0; r < th && !rejected; ++r) {
+                const RunList& row = image_rows[oy + r];
+                const RunList& pattern = template_rows[r];
+                auto it = lower_bound(row.begin(), row.end(), ox,
+                                      [](const pair<int, int>& run, int column) { return run.second < column; });
+                long long window_black = 0, overlap = 0;
+                size_t q = 0;
+                for (; it != row.end() && it->first <= window_end; ++it) {
+                    int start = max(it->first, ox) - ox;
+                    int end = min(it->second, window_end) - ox;
+                    window_black += end - start + 1;
+                    while (q < pattern.size() && pattern[q].second < start) ++q;
+                    for (size_t k = q; k < pattern.size() && pattern[k].first <= end; ++k) {
+                        overlap += min(end, pattern[k].second) - max(start, pattern[k].first) + 1;
+                    }
+                }
+                if (mode == MatchScore::Mismatch) {
+                    score += tmpl.rowBlackCount(r) + window_black - 2 * overlap;
+                    rejected = score > threshold;
+                } else {
+                    score += overlap;
+                    rejected = score + template_remaining[r + 1] < threshold;
+                }
+            }
+            if (!rejected) matches.push_back({ox, oy, score});
+        }
+    }
+    return matches;
+}
+
+// --- Convex Hull ---
+// Hulls are of the pixel squares, so points are lattice corners as in
+// Contour. Only the outer corners of a row's first and last run can be hull
+// vertices, which bounds the candidates at four per row.
+
+// Andrew's monotone chain; returns the hull counter-clockwise in maths
+// orientation (clockwise on screen, where y points down), without collinear points
+inline vector<pair<int, int>> convexHullOfPoints(vector<pair<int, int>> points) {
+    sort(points.begin(), points.end());
+    points.erase(unique(points.begin(), points.end()), points.end());
+    if (points.size() < 3) return points;
+    auto cross = [](const pair<int, int>& o, const pair<int, int>& a, const pair<int, int>& b) {
+        return static_cast<long long>(a.first - o.first) * (b.second - o.second) -
+               static_cast<long long>(a.second - o.second) * (b.first - o.first);
+    };
+    vector<pair<int, int>> hull(2 * points.size());
+    size_t k = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0) --k;
+        hull[k++] = points[i];
+    }
+    for (size_t i = points.size() - 1, lower = k + 1; i > 0; --i) {
+        while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0) --k;
+        hull[k++] = points[i - 1];
+    }
+    hull.resize(k - 1);
+    return hull;
+}
+
+inline void addRowExtremes(vector<pair<int, int>>& points, int y, int first_start, int last_end) {
+    points.emplace_back(first_start, y);
+    points.emplace_back(first_start, y + 1);
+    points.emplace_back(last_end + 1, y);
+    points.emplace_back(last_end + 1, y + 1);
+}
+
+// Convex hull of all black pixels in O(runs), from each row's extreme runs
+vector<pair<int, int>> convexHull(const RunLengthImage& img) {
+    vector<pair<int, int>> points;
+    for (int i = 0; i < img.getHeight(); ++i) {
+        const Node* current = img.rowHead(i);
+        if (current == nullptr) continue;
+        int first = current->start_index;
+        while (current->next != nullptr) current = current->next;
+        addRowExtremes(points, i, first, current->end_index);
+    }
+    return convexHullOfPoints(points);
+}
+
+// Convex hull of each component of a labeling produced by labelComponents on img
+vector<vector<pair<int, int>>> componentHulls(const RunLengthImage& img, const ComponentLabeling& labeling) {
+    size_t count = labeling.components.size();
+    vector<vector<pair<int, int>>> points(count);
+    vector<int> row_first(count, -1), row_last(count, -1);
+    vector<int> touched;
+    for (int i = 0; i < img.getHeight(); ++i) {
+        touched.clear();
+        int k = 0;
+        for (const Node* current = img.rowHead(i); current != nullptr; current = current->next, ++k) {
+            int label = labeling.run_labels[i][k];
+            if (row_first[label] == -1) {
+                row_first[label] = current->start_index;
+                touched.push_back(label);
+            }
+            row_last[label] = current->end_index;
+        }
+        for (int label : touched) {
+            addRowExtremes(points[label], i, row_first[label], row_last[label]);
+            row_first[label] = -1;
+        }
+    }
+    vector<vector<pair<int, int>>> hulls(count);
+    for (size_t c = 0; c < count; ++c) hulls[c] = convexHullOfPoints(move(points[c]));
+    return hulls;
+}
+
+struct OrientedRect {
+    double center_x = 0, center_y = 0;
+    double width = 0, height = 0; // width runs along angle
+    double angle = 0;             // Radians, y pointing down
+    array<pair<double, double>, 4> corners{};
+};
+
+// Minimum-area enclosing rectangle of a convex hull by rotating calipers: one
+// side of the optimum lies on a hull edge, and the three other support points
+// only ever advance as the edge index does, so the whole search is O(hull size).
+OrientedRect minAreaRect(const vector<pair<int, int>>& hull) {
+    OrientedRect best;
+    size_t n = hull.size();
+    if (n == 0) return best;
+    if (n < 3) {
+        // Degenerate hull: a point or a segment
+        double dx = hull[n - 1].first - hull[0].first, dy = hull[n - 1].second - hull[0].second;
+        best.center_x = (hull[0].first + hull[n - 1].first) / 2.0;
+        best.center_y = (hull[0].second + hull[n - 1].second) / 2.0;
+        best.width = sqrt(dx * dx + dy * dy);
+        best.angle = atan2(dy, dx);
+        best.corners = {hull[0], hull[0], hull[n - 1], hull[n - 1]};
+        return best;
+    }
+
+    auto px = [&](size_t k) { return static_cast<double>(hull[k % n].first); };
+    auto py = [&](size_t k) { return static_cast<double>(hull[k % n].second); };
+    double best_area = HUGE_VAL;
+    size_t far_u = 1, far_v = 1, near_u = 1; // Max along edge, max off edge, min along edge
+    for (size_t i = 0; i < n; ++i) {
+        double ex = px(i + 1) - px(i), ey = py(i + 1) - py(i);
+        double length = sqrt(ex * ex + ey * ey);
+        double ux = ex / length, uy = ey / length; // Along the edge
+        double vx = -uy, vy = ux;                  // Perpendicular to it
+        auto along = [&](size_t k) { return (px(k) - px(i)) * ux + (py(k) - py(i)) * uy; };
+        auto across = [&](size_t k) { return fabs((px(k) - px(i)) * vx + (py(k) - py(i)) * vy); };
+
+        far_u = max(far_u, i + 1);
+        while (along(far_u + 1) > along(far_u) + 1e-12) ++far_u;
+        far_v = max(far_v, far_u);
+        while (across(far_v + 1) > across(far_v) + 1e-12) ++far_v;
+        near_u = max(near_u, far_v);
+        while (along(near_u + 1) < along(near_u) - 1e-12) ++near_u;
+
+        double u_max = along(far_u), u_min = min(0.0, along(near_u));
+        double depth = across(far_v);
+        double area = (u_max - u_min) * depth;
+        if (area < best_area) {
+            best_area = area;
+            // The hull lies on the side of the edge that `across` measured
+            double side = ((px(far_v) - px(i)) * vx + (py(far_v) - py(i)) * vy) < 0 ? -1.0 : 1.0;
+            double ox = px(i), oy = py(i);
+            auto corner = [&](double u, double v) {
+                return make_pair(ox + u * ux + side * v * vx, oy + u * uy + side * v * vy);
+            };
+            best.corners = {corner(u_min, 0), corner(u_max, 0), corner(u_max, depth), corner(u_min, depth)};
+            best.width = u_max - u_min;
+            best.height = depth;
+            best.angle = atan2(uy, ux);
+            best.center_x = (best.corners[0].first + best.corners[2].first) / 2;
+            best.center_y = (best.corners[0].second + best.corners[2].second) / 2;
+        }
+    }
+    return best;
+}
+
+// Helper function to convert raw string data into a 2D grid
+vector<vector<int>> parseImageString(const string& raw_data, int& w, int& h) {
+    stringstream ss(raw_data);
+    
+    // Read dimensions (w, h)
+    ss >> w >> h;
+    
+    vector<vector<int>> grid(h, vector<int>(w));
+    
+    for (int i = 0; i < h; ++i) {
+        for (int j = 0; j < w; ++j) {
+            // Read 0 or 1 for pixel value
+            ss >> grid[i][j];
+        }
+    }
+    return grid;
+}
+
+
+int main() {
+    // Large 16x16 image data (from your previous input)
+    const string RAW_IMAGE_DATA = 
+        "16 16\n"
+        "1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 1\n"
+        "1 1 1 1 1 0 0 0 1 1 1 1 1 1 1 1\n"
+        "1 1 1 0 0 0 0 0 1 1 1 1 1 1 1 1\n"
+        "1 1 0 0 0 0 0 0 1 1 1 1 1 1 1 1\n"
+        "1 1 0 1 1 1 0 0 1 1 1 1 1 1 1 1\n"
+        "1 1 1 1 1 1 0 0 1 1 1 1 1 1 1 1\n"
+        "1 1 1 1 1 1 0 0 1 1 1 1 1 1 1 1\n"
+        "1 1 1 1 0 0 0 1 1 1 1 1 1 1 1 1\n"
+        "1 1 0 0 0 1 1 1 1 1 1 1 1 1 1 1\n"
+        "1 1 0 0 1 1 1 1 1 1 1 1 1 1 0 0\n"
+        "1 1 0 1 1 1 1 1 1 1 1 1 1 0 0 0\n"
+        "1 1 1 1 1 1 1 1 1 1 1 0 0 0 1 1\n"
+        "1 1 1 1 1 1 1 1 1 1 1 0 0 1 1 1\n"
+        "1 1 1 1 1 1 1 1 1 1 0 0 1 1 1 1\n"
+        "1 1 1 1 1 1 1 1 1 0 0 1 1 1 1 1\n"
+        "1 1 1 1 1 1 1 0 0 0 1 1 1 1 1 1";
+
+    // FIX 2: Declare w and h before use
+    int w = 0, h = 0;
+    vector<vector<int>> initial_grid = parseImageString(RAW_IMAGE_DATA, w, h);
+
+    cout << "--- Initializing 16x16 Compressed Images ---" << endl;
+
+    // Img1: The original image
+    unique_ptr<CompressedImageInterface> img1 = make_unique<RunLengthImage>(initial_grid, w, h);
+    cout << "Img1 Compressed (Initial): " << img1->toStringCompressed() << "\n\n";
+
+    // Img2: A copy that will be inverted
+    unique_ptr<CompressedImageInterface> img2 = make_unique<RunLengthImage>(initial_grid, w, h);
+    img2->invert();
+    cout << "Img2 Compressed (Inverted): " << img2->toStringCompressed() << "\n\n";
+    
+    // Test 1: XOR Operation
+    cout << "--- Testing XOR (Img1 ^ Img2) ---" << endl;
     cout << "Expected Result: All white (16 / characters)" << endl;
     img1->performXor(img2.get());
     cout << "Img1 after XOR: " << img1->toStringCompressed() << "\n\n";
@@ -283,6 +2972,268 @@ int main() {
     img1->performAnd(img2.get());
     cout << "Img1 after AND: " << img1->toStringCompressed() << endl;
 
+    // Test 3: Round trip through the compressed text format
+    cout << "\n--- Testing Compressed Round Trip (Img2) ---" << endl;
+    string img2_text = img2->toStringCompressed();
+    unique_ptr<RunLengthImage> img3 = RunLengthImage::parseCompressed(img2_text);
+    cout << "Round trip matches: " << (img3->toStringCompressed() == img2_text ? "yes" : "no") << endl;
+
+    // Test 4: Bit-plane AND/XOR must match bitwise AND/XOR of the grayscale values
+    cout << "\n--- Testing Bit-Plane AND/XOR (Gray1, Gray2) ---" << endl;
+    GrayscaleRunImage gray1({{200, 200, 15, 15}, {0, 255, 255, 90}}, 4, 2);
+    GrayscaleRunImage gray2({{255, 12, 12, 240}, {7, 7, 129, 90}}, 4, 2);
+    BitPlanes and_planes = gray1.toBitPlanes(false);
+    BitPlanes xor_planes = gray1.toBitPlanes(false);
+    BitPlanes gray_xor_planes = gray1.toBitPlanes(true);
+    BitPlanes planes2 = gray2.toBitPlanes(false);
+    BitPlanes gray_planes2 = gray2.toBitPlanes(true);
+    for (int b = 0; b < 8; ++b) {
+        and_planes.planes[b]->performAnd(planes2.planes[b].get());
+        xor_planes.planes[b]->performXor(planes2.planes[b].get());
+        gray_xor_planes.planes[b]->performXor(gray_planes2.planes[b].get());
+    }
+    cout << "Expected AND: 4 2, (0,0:200) (1,1:8) (2,2:12) (3,3:0) ,(0,0:0) (1,1:7) (2,2:129) (3,3:90) " << endl;
+    cout << "Planes AND:   " << GrayscaleRunImage::fromBitPlanes(and_planes)->toStringCompressed() << endl;
+    cout << "Expected XOR: 4 2, (0,0:55) (1,1:196) (2,2:3) (3,3:255) ,(0,0:7) (1,1:248) (2,2:126) (3,3:0) " << endl;
+    cout << "Planes XOR:   " << GrayscaleRunImage::fromBitPlanes(xor_planes)->toStringCompressed() << endl;
+    // Gray coding is linear over XOR, so XOR on Gray-coded planes also recomposes exactly
+    cout << "Gray-coded XOR: " << GrayscaleRunImage::fromBitPlanes(gray_xor_planes)->toStringCompressed() << endl;
+
+    // Test 5: Span edits merge touching runs and split runs without a row rebuild
+    cout << "\n--- Testing Span Edits (10x1 row: (1,2) (5,6)) ---" << endl;
+    unique_ptr<RunLengthImage> edit = RunLengthImage::parseCompressed("10 1, (1,2) (5,6) ");
+    edit->setSpan(0, 3, 4, 0);
+    cout << "Expected after black [3,4]: 10 1, (1,6)  | black 6 | runs 1" << endl;
+    cout << "Row after black [3,4]:      " << edit->toStringCompressed() << " | black " << edit->blackPixelCount()
+         << " | runs " << edit->rowRunCount(0) << endl;
+    edit->setSpan(0, 3, 4, 1);
+    cout << "Expected after white [3,4]: 10 1, (1,2) (5,6)  | black 4 | runs 2" << endl;
+    cout << "Row after white [3,4]:      " << edit->toStringCompressed() << " | black " << edit->blackPixelCount()
+         << " | runs " << edit->rowRunCount(0) << endl;
+
+    // Test 6: Morphology against hand-worked results; 5-tall kernels take the
+    // blocked (van Herk/Gil-Werman) path, 3-tall kernels the direct one.
+    cout << "\n--- Testing Morphology (rect kernels) ---" << endl;
+    auto checkMorphology = [](const string& input, const string& label, const function<void(RunLengthImage&)>& op,
+                              const string& expected) {
+        unique_ptr<RunLengthImage> img = RunLengthImage::parseCompressed(input);
+        op(*img);
+        string actual = img->toStringCompressed();
+        cout << "Expected " << label << ": " << expected << endl;
+        cout << "Result   " << label << ": " << actual << (actual == expected ? "  [match]" : "  [MISMATCH]") << endl;
+    };
+    const string dot = "7 5,  / , / ,(3,3) , / , / ";
+    checkMorphology(dot, "dilate 3x3 (dot)  ", [](RunLengthImage& m) { m.dilate(3, 3); },
+                    "7 5,  / ,(2,4) ,(2,4) ,(2,4) , / ");
+    checkMorphology(dot, "dilate 1x5 (dot)  ", [](RunLengthImage& m) { m.dilate(1, 5); },
+                    "7 5, (3,3) ,(3,3) ,(3,3) ,(3,3) ,(3,3) ");
+    checkMorphology(dot, "dilate 3x20000000 ", [](RunLengthImage& m) { m.dilate(3, 20000000); },
+                    "7 5, (2,4) ,(2,4) ,(2,4) ,(2,4) ,(2,4) ");
+    const string block = "7 7,  / ,(1,5) ,(1,5) ,(1,5) ,(1,5) ,(1,5) , / ";
+    checkMorphology(block, "erode 3x3 (block) ", [](RunLengthImage& m) { m.erode(3, 3); },
+                    "7 7,  / , / ,(2,4) ,(2,4) ,(2,4) , / , / ");
+    checkMorphology(block, "erode 1x5 (block) ", [](RunLengthImage& m) { m.erode(1, 5); },
+                    "7 7,  / , / , / ,(1,5) , / , / , / ");
+    checkMorphology("7 7,  / ,(1,4) ,(1,4) ,(1,4) ,(1,4) , / ,(6,6) ", "open 3x3 (speck)  ",
+                    [](RunLengthImage& m) { m.open(3, 3); }, "7 7,  / ,(1,4) ,(1,4) ,(1,4) ,(1,4) , / , / ");
+    checkMorphology("7 7,  / ,(1,1) ,(1,1) (4,4) ,(1,1) (4,4) ,(1,1) (4,4) ,(1,1) , / ", "open 1x5 (bars)  ",
+                    [](RunLengthImage& m) { m.open(1, 5); }, "7 7,  / ,(1,1) ,(1,1) ,(1,1) ,(1,1) ,(1,1) , / ");
+    checkMorphology("11 5,  / , / ,(2,4) (6,8) , / , / ", "close 3x3 (gap)   ",
+                    [](RunLengthImage& m) { m.close(3, 3); }, "11 5,  / , / ,(2,8) , / , / ");
+    checkMorphology("5 13,  / , / , / ,(2,2) ,(2,2) ,(2,2) , / ,(2,2) ,(2,2) ,(2,2) , / , / , / ", "close 1x5 (gap)   ",
+                    [](RunLengthImage& m) { m.close(1, 5); },
+                    "5 13,  / , / , / ,(2,2) ,(2,2) ,(2,2) ,(2,2) ,(2,2) ,(2,2) ,(2,2) , / , / , / ");
+
+    // Test 7: Contours of a ring (outer boundary plus hole) and of two pixels
+    // that touch only at a corner (one 8-connected contour)
+    cout << "\n--- Testing Contour Tracing ---" << endl;
+    auto printContours = [](const string& label, const vector<Contour>& contours) {
+        cout << label << ": " << contours.size() << " contour(s)" << endl;
+        for (const Contour& c : contours) {
+            cout << "  " << (c.is_hole ? "hole " : "outer") << " ";
+            for (const pair<int, int>& p : c.points) cout << "(" << p.first << "," << p.second << ") ";
+            cout << endl;
+        }
+    };
+    unique_ptr<RunLengthImage> ring = RunLengthImage::parseCompressed("5 5,  / ,(1,3) ,(1,1) (3,3) ,(1,3) , / ");
+    cout << "Expected ring: 2 contour(s)" << endl;
+    cout << "  outer (4,1) (4,4) (1,4) (1,1) " << endl;
+    cout << "  hole  (2,2) (2,3) (3,3) (3,2) " << endl;
+    printContours("Ring", traceContours(*ring));
+    unique_ptr<RunLengthImage> diagonal = RunLengthImage::parseCompressed("4 4,  / ,(1,1) ,(2,2) , / ");
+    cout << "Expected diagonal: 1 contour(s)" << endl;
+    cout << "  outer (2,1) (2,2) (3,2) (3,3) (2,3) (2,2) (1,2) (1,1) " << endl;
+    printContours("Diagonal", traceContours(*diagonal));
+
+    // Test 8: Regions of the demo image. The left blob and the right stroke are
+    // separate black regions, and the stroke walls off the bottom-right corner.
+    cout << "\n--- Testing Region Growing (demo image) ---" << endl;
+    RunLengthImage demo(initial_grid, w, h);
+    cout << "Expected region sizes (4/8): blob (6,5) 30/30 | stroke (15,9) 17/17 | corner (15,15) 20/20" << endl;
+    cout << "Region sizes (4/8):          blob (6,5) " << demo.regionAt(6, 5, 4)->blackPixelCount() << "/"
+         << demo.regionAt(6, 5, 8)->blackPixelCount() << " | stroke (15,9) " << demo.regionAt(15, 9, 4)->blackPixelCount()
+         << "/" << demo.regionAt(15, 9, 8)->blackPixelCount() << " | corner (15,15) "
+         << demo.regionAt(15, 15, 4)->blackPixelCount() << "/" << demo.regionAt(15, 15, 8)->blackPixelCount() << endl;
+    demo.floodFill(6, 5, 1, 8);
+    cout << "Expected black after erasing blob: 17" << endl;
+    cout << "Black after erasing blob:          " << demo.blackPixelCount() << endl;
+    demo.floodFill(15, 15, 0, 4);
+    cout << "Expected black after filling corner: 37" << endl;
+    cout << "Black after filling corner:          " << demo.blackPixelCount() << endl;
+    unique_ptr<RunLengthImage> corners = RunLengthImage::parseCompressed("4 4,  / ,(1,1) ,(2,2) , / ");
+    cout << "Expected diagonal pair region (4/8): 1/2" << endl;
+    cout << "Diagonal pair region (4/8):          " << corners->regionAt(1, 1, 4)->blackPixelCount() << "/"
+         << corners->regionAt(1, 1, 8)->blackPixelCount() << endl;
+
+    // Test 9: Rectangle counts stay correct before the coverage index is built,
+    // across edits that leave rows stale, and after a rebuild
+    // (bottom-right quadrant [8,15] x [8,15] of the demo image)
+    cout << "\n--- Testing Rectangle Counts Across Edits ---" << endl;
+    RunLengthImage counted(initial_grid, w, h);
+    unique_ptr<CompressedImageInterface> all_white = make_unique<RunLengthImage>(w, h);
+    cout << "Expected quadrant black (unbuilt / built): 16 / 16" << endl;
+    cout << "Quadrant black (unbuilt / built):          " << counted.blackPixelsInRect(8, 8, 15, 15);
+    counted.buildCoverageIndex();
+    cout << " / " << counted.blackPixelsInRect(8, 8, 15, 15) << endl;
+    counted.setSpan(12, 8, 15, 0);
+    cout << "Expected after black span on row 12: 22" << endl;
+    cout << "After black span on row 12:          " << counted.blackPixelsInRect(8, 8, 15, 15) << endl;
+    counted.performXor(all_white.get()); // XOR with all white inverts every pixel
+    cout << "Expected after XOR with white: 42" << endl;
+    cout << "After XOR with white:          " << counted.blackPixelsInRect(8, 8, 15, 15) << endl;
+    counted.flipHorizontal();
+    cout << "Expected after horizontal flip: 57 (left quadrant 42)" << endl;
+    cout << "After horizontal flip:          " << counted.blackPixelsInRect(8, 8, 15, 15) << " (left quadrant "
+         << counted.blackPixelsInRect(0, 8, 7, 15) << ")" << endl;
+    counted.buildCoverageIndex();
+    cout << "Expected after rebuilding: 57 (left quadrant 42)" << endl;
+    cout << "After rebuilding:          " << counted.blackPixelsInRect(8, 8, 15, 15) << " (left quadrant "
+         << counted.blackPixelsInRect(0, 8, 7, 15) << ")" << endl;
+
+    // Test 10: The 5x5 piece of the stroke at (9,11) is found by both scores;
+    // the thresholds reject every other offset before its last row
+    cout << "\n--- Testing Template Matching (5x5 stroke piece at (9,11)) ---" << endl;
+    RunLengthImage haystack(initial_grid, w, h);
+    unique_ptr<RunLengthImage> needle = haystack.crop(9, 11, 5, 5);
+    auto printMatches = [](const string& label, const vector<TemplateMatch>& matches) {
+        cout << label;
+        for (const TemplateMatch& m : matches) cout << "(" << m.x << "," << m.y << ") score " << m.score << " ";
+        cout << endl;
+    };
+    cout << "Expected mismatch <= 0:  (9,11) score 0 " << endl;
+    printMatches("Matches mismatch <= 0:   ", matchTemplate(haystack, *needle, MatchScore::Mismatch, 0));
+    cout << "Expected overlap >= 10: (9,11) score 10 " << endl;
+    printMatches("Matches overlap >= " + to_string(needle->blackPixelCount()) + ":  ",
+                 matchTemplate(haystack, *needle, MatchScore::Overlap, needle->blackPixelCount()));
+
+    // Test 11: A one-pixel diagonal bar. The hull is the staircase outline and the
+    // tightest rectangle lies along the diagonal: 6*sqrt(2) by sqrt(2), area 12.
+    cout << "\n--- Testing Minimum-Area Rectangle (6x6 diagonal bar) ---" << endl;
+    unique_ptr<RunLengthImage> bar =
+        RunLengthImage::parseCompressed("6 6, (0,0) ,(1,1) ,(2,2) ,(3,3) ,(4,4) ,(5,5) ");
+    vector<pair<int, int>> bar_hull = convexHull(*bar);
+    OrientedRect bar_rect = minAreaRect(bar_hull);
+    cout << "Expected hull: 6 points (0,0) (1,0) (6,5) (6,6) (5,6) (0,1) " << endl;
+    cout << "Hull:          " << bar_hull.size() << " points ";
+    for (const pair<int, int>& p : bar_hull) cout << "(" << p.first << "," << p.second << ") ";
+    cout << endl;
+    cout << "Expected rect: center (3, 3) | 8.48528 x 1.41421 | angle 0.785398 rad" << endl;
+    cout << "Rect:          center (" << bar_rect.center_x << ", " << bar_rect.center_y << ") | " << bar_rect.width
+         << " x " << bar_rect.height << " | angle " << bar_rect.angle << " rad" << endl;
+
+    // Test 12: A header claiming more rows than the text could hold is rejected
+    // before any row slots are allocated
+    cout << "\n--- Testing Compressed Header Validation ---" << endl;
+    cout << "Expected for \"1 1500000000, \": CompressedFormatException" << endl;
+    try {
+        RunLengthImage::parseCompressed("1 1500000000, ");
+        cout << "Result: parsed without error" << endl;
+    } catch (const CompressedFormatException& e) {
+        cout << "Result: CompressedFormatException (" << e.what() << ")" << endl;
+    }
+
+    // Test 13: PGM ingestion thresholds in-range samples and rejects samples
+    // above the header's maximum instead of wrapping them
+    cout << "\n--- Testing PGM Ingestion (threshold 50) ---" << endl;
+    istringstream pgm_ok("P2 2 1 255 200 10");
+    cout << "Expected \"P2 2 1 255 200 10\": 2 1, (1,1) " << endl;
+    cout << "Result   \"P2 2 1 255 200 10\": " << RunLengthImage::fromPGM(pgm_ok, 50)->toStringCompressed() << endl;
+    istringstream pgm_bad("P2 2 1 255 300 10");
+    cout << "Expected \"P2 2 1 255 300 10\": runtime_error" << endl;
+    try {
+        string parsed = RunLengthImage::fromPGM(pgm_bad, 50)->toStringCompressed();
+        cout << "Result   \"P2 2 1 255 300 10\": " << parsed << endl;
+    } catch (const runtime_error& e) {
+        cout << "Result   \"P2 2 1 255 300 10\": runtime_error (" << e.what() << ")" << endl;
+    }
+
+    // Test 14: Pixel lookups agree whether rows walk their lists, use the built
+    // index, or fall back after an edit. Points: (5,1) (4,1) (15,9) (12,12) (0,0).
+    cout << "\n--- Testing Pixel Lookups (demo image) ---" << endl;
+    RunLengthImage lookup(initial_grid, w, h);
+    vector<pair<int, int>> probes{{5, 1}, {4, 1}, {15, 9}, {12, 12}, {0, 0}};
+    auto printPixels = [&](const string& label) {
+        cout << label;
+        for (const pair<int, int>& p : probes) cout << lookup.getPixel(p.first, p.second);
+        cout << " / batched ";
+        for (int v : lookup.getPixels(probes)) cout << v;
+        cout << endl;
+    };
+    cout << "Expected before index:  01001 / batched 01001" << endl;
+    printPixels("Before index:           ");
+    lookup.buildPixelIndex();
+    cout << "Expected with index:    01001 / batched 01001" << endl;
+    printPixels("With index:             ");
+    lookup.setSpan(1, 0, 4, 0);
+    cout << "Expected after editing: 00001 / batched 00001" << endl;
+    printPixels("After editing:          ");
+
+    // Test 15: Downsampling a 5x3 image by 2 into 3x2 blocks. Band 0 blocks
+    // hold 3/4, 0/4 and 1/2 black; band 1 (the bottom edge) holds 0/2, 2/2, 1/1.
+    cout << "\n--- Testing Downsampling and Pyramid (5x3 image) ---" << endl;
+    unique_ptr<RunLengthImage> coarse = RunLengthImage::parseCompressed("5 3, (0,1) (4,4) ,(0,0) ,(2,4) ");
+    cout << "Expected AnyBlack x2: 3 2, (0,0) (2,2) ,(1,2) " << endl;
+    cout << "Result   AnyBlack x2: " << coarse->downsample(2, RunLengthImage::Reduction::AnyBlack)->toStringCompressed() << endl;
+    cout << "Expected AllBlack x2: 3 2,  / ,(1,2) " << endl;
+    cout << "Result   AllBlack x2: " << coarse->downsample(2, RunLengthImage::Reduction::AllBlack)->toStringCompressed() << endl;
+    cout << "Expected Majority x2: 3 2, (0,0) ,(1,2) " << endl;
+    cout << "Result   Majority x2: " << coarse->downsample(2, RunLengthImage::Reduction::Majority)->toStringCompressed() << endl;
+    cout << "Expected AnyBlack / AllBlack / Majority x INT_MAX: 1 1, (0,0)  / 1 1,  /  / 1 1,  / " << endl;
+    cout << "Result   AnyBlack / AllBlack / Majority x INT_MAX: "
+         << coarse->downsample(INT_MAX, RunLengthImage::Reduction::AnyBlack)->toStringCompressed() << " / "
+         << coarse->downsample(INT_MAX, RunLengthImage::Reduction::AllBlack)->toStringCompressed() << " / "
+         << coarse->downsample(INT_MAX, RunLengthImage::Reduction::Majority)->toStringCompressed() << endl;
+    RunLengthPyramid pyramid(*coarse, RunLengthImage::Reduction::AnyBlack);
+    auto describeLevel = [&](int k) {
+        const RunLengthImage& level = pyramid.level(k);
+        return to_string(level.getWidth()) + "x" + to_string(level.getHeight()) + " black " +
+               to_string(level.blackPixelCount());
+    };
+    cout << "Expected pyramid: 4 levels | level 2: 2x1 black 2 | level 3: 1x1 black 1" << endl;
+    cout << "Pyramid:          " << pyramid.levelCount() << " levels | level 2: " << describeLevel(2)
+         << " | level 3: " << describeLevel(3) << endl;
+
+    // Test 16: Nearest-neighbour resampling of a 3x2 image, empty sources and
+    // targets, and size overflow
+    cout << "\n--- Testing Resize and Upscale (3x2 image) ---" << endl;
+    unique_ptr<RunLengthImage> small = RunLengthImage::parseCompressed("3 2, (0,0) , / ");
+    cout << "Expected upscale x2:     6 4, (0,1) ,(0,1) , / , / " << endl;
+    cout << "Result   upscale x2:     " << small->upscale(2)->toStringCompressed() << endl;
+    cout << "Expected resize to 2x1:  2 1, (0,0) " << endl;
+    cout << "Result   resize to 2x1:  " << small->resize(2, 1)->toStringCompressed() << endl;
+    cout << "Expected scale 0.5, 1.0: 2 2, (0,0) , / " << endl;
+    cout << "Result   scale 0.5, 1.0: " << small->scale(0.5, 1.0)->toStringCompressed() << endl;
+    cout << "Expected 0x0 and 5x0 resized to 0x5 and 0x3: 0 5,  / , / , / , / , /  | 0 3,  / , / , / " << endl;
+    cout << "Result   0x0 and 5x0 resized to 0x5 and 0x3: " << RunLengthImage(0, 0).resize(0, 5)->toStringCompressed()
+         << " | " << RunLengthImage(5, 0).resize(0, 3)->toStringCompressed() << endl;
+    cout << "Expected upscale x2^30: out_of_range" << endl;
+    try {
+        small->upscale(1 << 30);
+        cout << "Result   upscale x2^30: no error" << endl;
+    } catch (const out_of_range& e) {
+        cout << "Result   upscale x2^30: out_of_range (" << e.what() << ")" << endl;
+    }
+
     cout << "\nAll boolean operations completed successfully." << endl;
 
     return 0;